@@ -0,0 +1,38 @@
+# Generate a C++ source file with the contents of the OpenCL source files, as a constexpr table of
+# file names and texts, for readSourceFile() to use at run time, see cl-kernel-sources.hh.
+#
+# Run in script mode, with the ';' separated list of files in SOURCE_FILES:
+#	cmake "-DSOURCE_FILES=cl-matrix-rand.cl;cl-double-pendulum.cl" -DOUTPUT_FILE=cl-kernel-sources.cc -P EmbedOpenCLSources.cmake
+
+if (NOT DEFINED SOURCE_FILES OR NOT DEFINED OUTPUT_FILE)
+    message(FATAL_ERROR "Usage: cmake -DSOURCE_FILES=<files> -DOUTPUT_FILE=<file> -P EmbedOpenCLSources.cmake")
+endif()
+
+set(SOURCE_ARRAYS "")
+set(SOURCE_TABLE "")
+set(SOURCE_INDEX 0)
+
+foreach(SOURCE_FILE ${SOURCE_FILES})
+    get_filename_component(SOURCE_NAME "${SOURCE_FILE}" NAME)
+    file(READ "${SOURCE_FILE}" SOURCE_HEX HEX)
+    string(LENGTH "${SOURCE_HEX}" SOURCE_LENGTH)
+    math(EXPR SOURCE_LENGTH "${SOURCE_LENGTH} / 2")
+
+    # Character literals, 16 to a line, so any file content (quotes, backslashes, long lines) is kept as is
+    string(REGEX REPLACE "([0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f][0-9a-f])" "\\1\n\t" SOURCE_HEX "${SOURCE_HEX}")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "'\\\\x\\1', " SOURCE_CHARS "${SOURCE_HEX}")
+    string(REPLACE ", \n" ",\n" SOURCE_CHARS "${SOURCE_CHARS}")
+
+    string(APPEND SOURCE_ARRAYS "// ${SOURCE_NAME}\nstatic constexpr char source_${SOURCE_INDEX}[] =\n{\n\t${SOURCE_CHARS}'\\0'\n};\n\n")
+    string(APPEND SOURCE_TABLE "    { \"${SOURCE_NAME}\", source_${SOURCE_INDEX}, ${SOURCE_LENGTH}u },\n")
+
+    math(EXPR SOURCE_INDEX "${SOURCE_INDEX} + 1")
+endforeach()
+
+file(WRITE "${OUTPUT_FILE}"
+    "// Generated by EmbedOpenCLSources.cmake, do not edit\n\n"
+    "#include <cstddef>\n\n"
+    "#include \"cl-kernel-sources.hh\"\n\n"
+    "${SOURCE_ARRAYS}"
+    "extern constexpr EmbeddedSource embedded_sources[] =\n{\n${SOURCE_TABLE}};\n\n"
+    "extern std::size_t const embedded_source_count = sizeof embedded_sources / sizeof embedded_sources[0];\n")
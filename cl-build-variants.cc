@@ -0,0 +1,349 @@
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "cl-platform-info.hh"
+#include "cl-matrix-mult.hh"
+#include "cl-gemm-tuner.hh"
+#include "cl-double-pendulum.hh"
+#include "cl-program-cache.hh"
+#include "cl-build-variants.hh"
+
+using std::size_t;
+using std::string;
+using std::vector;
+using std::numeric_limits;
+using std::min;
+using std::max;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::ostringstream;
+using std::cout;
+using std::clog;
+using std::endl;
+using std::setw;
+using std::setprecision;
+using std::fixed;
+using std::scientific;
+using std::left;
+using std::right;
+
+using cl::Error;
+using cl::Context;
+using cl::Device;
+using cl::CommandQueue;
+using cl::Program;
+using cl::Kernel;
+using cl::Buffer;
+using cl::EnqueueArgs;
+using cl::Event;
+using cl::NDRange;
+
+// Same values as in cl-double-pendulum.cl, for the -D build options and for the pendulum energy
+static double const
+    PENDULUM_TIME_STEP = 0.001,
+    PENDULUM_L1 = 0.43,
+    PENDULUM_M1 = 1.23,
+    PENDULUM_L2 = 0.48,
+    PENDULUM_M2 = 1.49,
+    PENDULUM_G  = 9.81;
+
+static auto const VARIANT_SIMULATION_TIME = milliseconds(100);
+static cl_ulong const VARIANT_MAX_STEP_COUNT = 1u << 20;
+static cl::size_type const VARIANT_GEMM_SIZE = 1024u;
+
+// Floating-point build options to compare, with the physical constants of the simulation given as -D
+// options or as program scope constants
+struct BuildVariant
+{
+    char const *options;
+    bool constants;
+};
+
+static BuildVariant const buildVariants[] =
+{
+    { "", false },
+    { "-cl-mad-enable", false },
+    { "-cl-denorms-are-zero", false },
+    { "-cl-finite-math-only", false },
+    { "-cl-fast-relaxed-math", false },
+    { "", true },
+    { "-cl-fast-relaxed-math", true }
+};
+
+static string pendulum_options(BuildVariant const &variant)
+{
+    ostringstream options;
+
+    options << variant.options;
+
+    if (variant.constants)
+	options << fixed << setprecision(9) << (*variant.options ? " " : "")
+	    << "-DTIME_STEP=" << PENDULUM_TIME_STEP << "f -DROD_LENGTH_1=" << PENDULUM_L1 << "f -DMASS_1=" << PENDULUM_M1
+	    << "f -DROD_LENGTH_2=" << PENDULUM_L2 << "f -DMASS_2=" << PENDULUM_M2 << 'f';
+
+    return options.str();
+}
+
+static string variant_name(BuildVariant const &variant)
+{
+    string name = variant.options;
+
+    if (variant.constants)
+	name += name.empty() ? "-D constants" : " -D constants";
+
+    return name.empty() ? "(default)" : name;
+}
+
+// Kinetic and potential energy for the state { theta1, theta2, omega1, omega2 } of the double pendulum
+static double pendulum_energy(cl_float4 const &state)
+{
+    double const theta1 = state.s[0], theta2 = state.s[1], omega1 = state.s[2], omega2 = state.s[3];
+
+    return
+	(PENDULUM_M1 + PENDULUM_M2) * PENDULUM_L1 * PENDULUM_L1 * omega1 * omega1 / 2.0
+	    +
+	PENDULUM_M2 * PENDULUM_L2 * PENDULUM_L2 * omega2 * omega2 / 2.0
+	    +
+	PENDULUM_M2 * PENDULUM_L1 * PENDULUM_L2 * omega1 * omega2 * std::cos(theta1 - theta2)
+	    -
+	(PENDULUM_M1 + PENDULUM_M2) * PENDULUM_G * PENDULUM_L1 * std::cos(theta1)
+	    -
+	PENDULUM_M2 * PENDULUM_G * PENDULUM_L2 * std::cos(theta2);
+}
+
+class PendulumVariant
+{
+    protected:
+	Program program;
+	KernelFunction<Buffer, cl_ulong> simulationFn;
+
+    public:
+	PendulumVariant(Context &context, BuildVariant const &variant);
+
+	Kernel kernel();
+	cl_ulong run(CommandQueue &queue, Buffer &states, cl::size_type itemCount, cl_ulong stepCount);
+};
+
+PendulumVariant::PendulumVariant(Context &context, BuildVariant const &variant)
+    : program(build_cached_program(context, pendulumProgramSource(), pendulum_options(variant))),
+      simulationFn(program, "doublePendulumState")
+{
+}
+
+inline Kernel PendulumVariant::kernel()
+{
+    return simulationFn.getKernel();
+}
+
+// Run the simulation and return the kernel time in nanoseconds
+cl_ulong PendulumVariant::run(CommandQueue &queue, Buffer &states, cl::size_type itemCount, cl_ulong stepCount)
+{
+    Event event = simulationFn(EnqueueArgs(queue, NDRange(itemCount)), states, stepCount);
+    event.wait();
+
+    return event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+}
+
+// Largest energy change over the simulation for one work item, relative to the largest potential energy
+static double energy_drift(vector<cl_float4> const &states, cl::size_type itemCount)
+{
+    double const energyScale = PENDULUM_G * ((PENDULUM_M1 + PENDULUM_M2) * PENDULUM_L1 + PENDULUM_M2 * PENDULUM_L2);
+    double drift = 0.0;
+
+    for (cl::size_type i = 0u; i < itemCount; i++)
+    {
+	double const itemDrift = std::fabs(pendulum_energy(states[itemCount + i]) - pendulum_energy(states[i])) / energyScale;
+
+	if (!std::isfinite(itemDrift))
+	    return numeric_limits<double>::infinity();
+
+	drift = max(drift, itemDrift);
+    }
+
+    return drift;
+}
+
+// Best kernel time of pass_count runs of the tiled multiply, in nanoseconds
+static cl_ulong time_gemm_variant(MatrixKernels<cl_float> &kernels, CommandQueue &queue, Buffer &m, Buffer &n, Buffer &result, unsigned pass_count)
+{
+    cl::size_type const size = VARIANT_GEMM_SIZE;
+    EnqueueArgs const multiplyArgs(queue, kernels.globalSize(size, size), kernels.localSize());
+    cl_ulong bestTime = numeric_limits<cl_ulong>::max();
+
+    kernels.multiply_matrix_tile(multiplyArgs, m, false, n, false, result, size, size, size, 1.0f, 0.0f);
+    queue.finish();
+
+    for (unsigned pass = 0u; pass < pass_count; pass++)
+    {
+	Event event = kernels.multiply_matrix_tile(multiplyArgs, m, false, n, false, result, size, size, size, 1.0f, 0.0f);
+	event.wait();
+
+	bestTime = min(bestTime, event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+    }
+
+    return bestTime;
+}
+
+// Largest difference from the default build result, relative to the largest element of that result
+static double gemm_error(vector<cl_float> const &result, vector<cl_float> const &reference)
+{
+    double maxDiff = 0.0, maxValue = 0.0;
+
+    for (size_t i = 0u; i < result.size(); i++)
+    {
+	double const diff = std::fabs(static_cast<double>(result[i]) - reference[i]);
+
+	if (!std::isfinite(diff))
+	    return numeric_limits<double>::infinity();
+
+	maxDiff = max(maxDiff, diff);
+	maxValue = max(maxValue, std::fabs(static_cast<double>(reference[i])));
+    }
+
+    return maxValue > 0.0 ? maxDiff / maxValue : maxDiff;
+}
+
+// Time to build the program from source, without the binary cache, and from the SPIR-V module if the
+// device takes one for the same options
+static void show_program_build_time(Context &context, char const *programName, char const *fileName, string const &options)
+{
+    string const source = readSourceFile(fileName);
+    auto startTime = steady_clock::now();
+
+    Program sourceProgram(context, source, false);
+    sourceProgram.build(options.c_str());
+
+    duration<double, std::milli> const sourceTime = steady_clock::now() - startTime;
+
+    cout << "\t" << programName << " build time from source: " << fixed << setprecision(1) << sourceTime.count() << " ms";
+
+    Program ilProgram;
+
+    startTime = steady_clock::now();
+
+    if (build_il_program(context, fileName, options, ilProgram))
+    {
+	duration<double, std::milli> const ilTime = steady_clock::now() - startTime;
+
+	cout << ", from SPIR-V: " << ilTime.count() << " ms (" << setprecision(2) << sourceTime.count() / ilTime.count() << "x)" << endl;
+    }
+    else
+	cout << ", no SPIR-V module for the device" << endl;
+}
+
+static void show_variant_speedup(cl_ulong referenceTime, cl_ulong time)
+{
+    cout << setw(10) << fixed << setprecision(3) << static_cast<double>(referenceTime) / time << 'x';
+}
+
+extern void probe_build_variants(Device &device, unsigned pass_count)
+{
+    Context context(device);
+    CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+
+    cl::size_type const gemmSize = VARIANT_GEMM_SIZE;
+    GemmConfig gemmConfig;
+
+    if (!load_gemm_config(device, MatrixKernels<cl_float>::typeName(), matrixProgramSource(), gemmConfig))
+	gemmConfig = Matrix::defaultGemmConfig(device, 32u, 4u, 1u);
+
+    show_program_build_time(context, "Simulation", pendulumProgramFile(), string());
+    show_program_build_time(context, "Matrix multiplication", matrixProgramFile(), MatrixKernels<cl_float>::programOptions(context, gemmConfig));
+
+    Buffer
+	m(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, sizeof(cl_float) * gemmSize * gemmSize),
+	n(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, sizeof(cl_float) * gemmSize * gemmSize),
+	result(context, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY, sizeof(cl_float) * gemmSize * gemmSize);
+
+    vector<cl_float> referenceResult(gemmSize * gemmSize), variantResult(gemmSize * gemmSize);
+    cl_ulong referenceGemmTime;
+
+    // Inputs are filled once with the default build, so all variants multiply the same matrices
+    {
+	MatrixKernels<cl_float> kernels(context, gemmConfig);
+
+	kernels.random_fill_block(EnqueueArgs(queue, kernels.randomFillSize(gemmSize, gemmSize)), m, gemmSize, gemmSize, -1.0f, 1.0f, 0u, 0u);
+	kernels.random_fill_block(EnqueueArgs(queue, kernels.randomFillSize(gemmSize, gemmSize)), n, gemmSize, gemmSize, -1.0f, 1.0f, 0u, 1u);
+	referenceGemmTime = time_gemm_variant(kernels, queue, m, n, result, pass_count);
+	queue.enqueueReadBuffer(result, true, 0u, sizeof(cl_float) * referenceResult.size(), referenceResult.data());
+    }
+
+    // Size the simulation with the default build, for about VARIANT_SIMULATION_TIME for each run
+    PendulumVariant referencePendulum(context, buildVariants[0]);
+    cl::size_type const itemCount =
+	referencePendulum.kernel().getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device) * device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() * 4u;
+    Buffer states(context, CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, sizeof(cl_float4) * itemCount * 2u);
+    vector<cl_float4> stateValues(itemCount * 2u);
+    cl_ulong stepCount = 64u, referenceSimulationTime;
+
+    while
+	(
+	    nanoseconds(referenceSimulationTime = referencePendulum.run(queue, states, itemCount, stepCount)) < VARIANT_SIMULATION_TIME
+		&&
+	    stepCount < VARIANT_MAX_STEP_COUNT
+	)
+    {
+	stepCount *= 2u;
+    }
+
+    for (unsigned pass = 1u; pass < pass_count; pass++)
+	referenceSimulationTime = min(referenceSimulationTime, referencePendulum.run(queue, states, itemCount, stepCount));
+
+    clog << "\tBuild options for " << itemCount << " simulations of " << stepCount << " steps, and " << gemmSize << 'x' << gemmSize << " float matrices:" << endl;
+    cout << "\t" << left << setw(40) << "Options" << right << setw(11) << "Simulation" << setw(14) << "Energy drift" << setw(11) << "GEMM" << setw(14) << "GEMM error" << endl;
+
+    for (auto const &variant: buildVariants)
+    {
+	cout << "\t" << left << setw(40) << variant_name(variant) << right;
+
+	try
+	{
+	    PendulumVariant pendulum(context, variant);
+	    cl_ulong simulationTime = numeric_limits<cl_ulong>::max();
+
+	    for (unsigned pass = 0u; pass < pass_count; pass++)
+		simulationTime = min(simulationTime, pendulum.run(queue, states, itemCount, stepCount));
+
+	    queue.enqueueReadBuffer(states, true, 0u, sizeof(cl_float4) * stateValues.size(), stateValues.data());
+
+	    show_variant_speedup(referenceSimulationTime, simulationTime);
+	    cout << setw(14) << scientific << setprecision(2) << energy_drift(stateValues, itemCount);
+
+	    // The -D constants only apply to the simulation
+	    if (variant.constants)
+		cout << setw(11) << '-' << setw(14) << '-';
+	    else
+	    {
+		MatrixKernels<cl_float> kernels(context, gemmConfig, variant.options);
+		cl_ulong const gemmTime = time_gemm_variant(kernels, queue, m, n, result, pass_count);
+
+		queue.enqueueReadBuffer(result, true, 0u, sizeof(cl_float) * variantResult.size(), variantResult.data());
+
+		show_variant_speedup(referenceGemmTime, gemmTime);
+		cout << setw(14) << scientific << setprecision(2) << gemm_error(variantResult, referenceResult);
+	    }
+
+	    cout << endl;
+	}
+	catch (Error const &error)
+	{
+	    cout << endl << "\tOpenCL error " << error_string(error.err()) << " in call to function " << error.what() << "()" << endl;
+	}
+    }
+}
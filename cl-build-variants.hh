@@ -0,0 +1,15 @@
+#if !defined(CL_BUILD_VARIANTS_HH)
+#define CL_BUILD_VARIANTS_HH
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+// Build the double pendulum and the matrix multiplication kernels with each set of floating-point build
+// options (like -cl-fast-relaxed-math), and show the speedup over the default build next to the energy
+// drift of the simulation and the relative error of the multiplication result
+extern void probe_build_variants(cl::Device &device, unsigned pass_count);
+
+#endif // !defined(CL_BUILD_VARIANTS_HH)
@@ -2,7 +2,14 @@
 #include <cstdint>
 #include <chrono>
 #include <memory>
+#include <vector>
 #include <map>
+#include <utility>
+#include <functional>
+#include <exception>
+#include <thread>
+#include <string>
+#include <stdexcept>
 #include <iostream>
 #include <iomanip>
 
@@ -12,13 +19,21 @@
 # include <CL/cl2.hpp>
 #endif
 
+#include "cl-platform-info.hh"
 #include "cl-matrix-mult.hh"
+#include "cl-program-cache.hh"
 #include "cl-double-pendulum.hh"
 
 using std::size_t;
+using std::string;
 using std::intptr_t;
 using std::unique_ptr;
+using std::vector;
 using std::map;
+using std::pair;
+using std::reference_wrapper;
+using std::exception_ptr;
+using std::thread;
 using std::chrono::duration_cast;
 using std::chrono::milliseconds;
 using std::chrono::nanoseconds;
@@ -42,7 +57,64 @@ extern void CL_CALLBACK context_error_notification(char const *error_info, void
     cerr << "OpenCL Context error: " << error_info << endl;
 }
 
-static char const benchmark_file_name[] = "./cl-double-pendulum.cl";
+static char const benchmark_file_name[] = "cl-double-pendulum.cl";
+static size_t const result_buffer_size = sizeof(cl_char) * 128;
+
+char const *pendulumProgramFile()
+{
+    return benchmark_file_name;
+}
+
+string pendulumProgramSource()
+{
+    return readSourceFile(benchmark_file_name);
+}
+
+char const *simulationPrecisionName(SimulationPrecision precision)
+{
+    switch (precision)
+    {
+	case SimulationPrecision::Half:
+	    return "half";
+	case SimulationPrecision::Single:
+	    return "float";
+	case SimulationPrecision::Double:
+	    return "double";
+    }
+
+    return "-";
+}
+
+// Build options for the kernel source, see FLOAT_TYPE, STATE_TYPE and ITEM_WIDTH. The default simulation
+// has no options, to match the SPIR-V module.
+static string simulation_options(unsigned itemWidth, SimulationPrecision precision)
+{
+    string options;
+
+    if (precision != SimulationPrecision::Single)
+	options = string("-DFLOAT_TYPE=") + simulationPrecisionName(precision);
+
+    if (precision == SimulationPrecision::Half)
+	options += " -DSTATE_TYPE=float";
+
+    if (itemWidth > 1u)
+	options += (options.empty() ? "" : " ") + string("-DITEM_WIDTH=") + std::to_string(itemWidth);
+
+    return options;
+}
+
+bool DoublePendulumSimulation::hasPrecision(Device const &device, SimulationPrecision precision)
+{
+    switch (precision)
+    {
+	case SimulationPrecision::Half:
+	    return has_extension(device.getInfo<CL_DEVICE_EXTENSIONS>(), "cl_khr_fp16");
+	case SimulationPrecision::Double:
+	    return device.getInfo<CL_DEVICE_DOUBLE_FP_CONFIG>() != 0;
+	default:
+	    return true;
+    }
+}
 
 static cl_command_queue create_command_queue(Context &context, Device &device)
 {
@@ -55,7 +127,7 @@ static cl_command_queue create_command_queue(Context &context, Device &device)
     return cmd_queue;
 }
 
-DoublePendulumSimulation::DoublePendulumSimulation(Device &device)
+DoublePendulumSimulation::DoublePendulumSimulation(Device &device, unsigned itemWidth, SimulationPrecision precision)
     : device(device),
 	context_prop
 	{
@@ -65,34 +137,25 @@ DoublePendulumSimulation::DoublePendulumSimulation(Device &device)
 	},
 	context(device, context_prop.data(), context_error_notification),
 	cmdQueue(create_command_queue(context, device)),
-	program(context, readSourceFile(benchmark_file_name), false)
+	itemWidth(itemWidth),
+	precision(precision)
 {
+    if (itemWidth != 1u && itemWidth != 2u && itemWidth != 4u && itemWidth != 8u)
+	throw std::invalid_argument("Pendulum count per work item should be 1, 2, 4 or 8");
+
+    if (!hasPrecision(device, precision))
+	throw std::runtime_error(string("Precision ") + simulationPrecisionName(precision) + " is not supported by device " + device.getInfo<CL_DEVICE_NAME>());
 }
 
 void DoublePendulumSimulation::build(size_t result_buffer_size)
 {
     try
     {
-	program.build();
+	program = build_file_program(context, benchmark_file_name, simulation_options(itemWidth, precision));
     }
     catch(Error const &error)
     {
-	if (error.err() == CL_BUILD_PROGRAM_FAILURE)
-	{
-#if defined(CL_HPP_PARAM_NAME_INFO_1_0_)
-	    auto const buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>();
-
-	    if (!buildLog.empty())
-		for (auto const &output_msg: buildLog)
-		    cerr << "Build output from device " << output_msg.first.getInfo<CL_DEVICE_NAME>() << ":\n\t" << output_msg.second << std::endl;
-#else
-	    string deviceBuildLog;
-
-	    program.getInfo(CL_PROGRAM_BUILD_LOG, &deviceBuildLog);
-	    cerr << "Build output:\n" << deviceBuildLog;
-#endif
-	}
-	else
+	if (error.err() != CL_BUILD_PROGRAM_FAILURE)
 	    cerr << "OpenCL error: " << error.what() << endl;
 
 	throw;
@@ -110,15 +173,15 @@ static size_t itemCount(NDRange const &range)
     return dimensions[0] * dimensions[1] * dimensions[2];
 }
 
-unsigned long DoublePendulumSimulation::runSimulation(NDRange const &globalSize, NDRange const &localSize)
+cl_ulong DoublePendulumSimulation::runSimulation(NDRange const &globalSize, NDRange const &localSize)
 {
     static unsigned simulation_count = 0;
 
     Event fn_event = (*simulationFn)(EnqueueArgs(cmdQueue, NDRange(0), globalSize, localSize), result, iterCount);
     cmdQueue.finish();
 
-    unsigned long execTime = static_cast<unsigned long>((fn_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - fn_event.getProfilingInfo<CL_PROFILING_COMMAND_START>() + 500000UL) / 1000000UL);
-    // clog << "Kernel time " << ++simulation_count << " (" << setw(4) << itemCount(globalSize) << '/' << itemCount(localSize) << "): " << execTime << "ms" << endl;
+    cl_ulong execTime = fn_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - fn_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    // clog << "Kernel time " << ++simulation_count << " (" << setw(4) << itemCount(globalSize) << '/' << itemCount(localSize) << "): " << execTime << "ns" << endl;
 
     return execTime;
 }
@@ -150,17 +213,88 @@ void DoublePendulumSimulation::probeIterationCount(milliseconds targetDuration)
     iterCount = (iterCount * duration_cast<nanoseconds>(targetDuration).count() * 3U + executionTime / 2) / executionTime;
 }
 
-static map<cl_platform_id, map<cl_device_id, unique_ptr<DoublePendulumSimulation>>>
+// Simulations for each device, by precision and pendulum count per work item
+static map<cl_platform_id, map<cl_device_id, map<pair<SimulationPrecision, unsigned>, unique_ptr<DoublePendulumSimulation>>>>
     pendulumSimulations;
 
-DoublePendulumSimulation &DoublePendulumSimulation::get(cl::Device &device)
+// Build errors from buildAll(), rethrown by get() for the device and simulation, with an empty entry for each
+// simulation built
+static map<cl_device_id, map<pair<SimulationPrecision, unsigned>, exception_ptr>>
+    pendulumBuildErrors;
+
+static bool has_compiler(Device &device)
+{
+    cl_bool has_linker = false;
+
+    return
+	device.getInfo<CL_DEVICE_AVAILABLE>()
+	    &&
+	device.getInfo<CL_DEVICE_COMPILER_AVAILABLE>()
+	    &&
+	(device.getInfo(CL_DEVICE_LINKER_AVAILABLE, &has_linker), has_linker);
+}
+
+void DoublePendulumSimulation::buildAll(vector<reference_wrapper<Device>> const &devices, vector<pair<SimulationPrecision, unsigned>> const &simulations)
 {
-    unique_ptr<DoublePendulumSimulation> &ptr = pendulumSimulations[device.getInfo<CL_DEVICE_PLATFORM>()][device()];
+    vector<thread> threads;
+
+    for (Device &device: devices)
+    {
+	if (!has_compiler(device))
+	    continue;
+
+	for (auto const &simulation: simulations)
+	{
+	    unique_ptr<DoublePendulumSimulation> &ptr = pendulumSimulations[device.getInfo<CL_DEVICE_PLATFORM>()][device()][simulation];
+
+	    if (ptr || pendulumBuildErrors[device()].count(simulation) || !hasPrecision(device, simulation.first))
+		continue;
+
+	    exception_ptr &buildError = pendulumBuildErrors[device()][simulation];
+
+	    threads.emplace_back
+		(
+		    [&ptr, &buildError, &device, simulation]()
+		    {
+			try
+			{
+			    unique_ptr<DoublePendulumSimulation> newSimulation(new DoublePendulumSimulation(device, simulation.second, simulation.first));
+
+			    newSimulation->build(result_buffer_size);
+			    ptr = std::move(newSimulation);
+			}
+			catch (...)
+			{
+			    buildError = std::current_exception();
+			}
+		    }
+		);
+	}
+    }
+
+    for (auto &buildThread: threads)
+	buildThread.join();
+}
+
+DoublePendulumSimulation &DoublePendulumSimulation::get(cl::Device &device, unsigned pendulumsPerItem, SimulationPrecision precision)
+{
+    unique_ptr<DoublePendulumSimulation> &ptr = pendulumSimulations[device.getInfo<CL_DEVICE_PLATFORM>()][device()][{ precision, pendulumsPerItem }];
 
     if (!ptr)
     {
-	ptr.reset(new DoublePendulumSimulation(device));
-	ptr->build(sizeof(cl_char) * 128);
+	auto &deviceBuildErrors = pendulumBuildErrors[device()];
+	auto it = deviceBuildErrors.find({ precision, pendulumsPerItem });
+
+	if (it != deviceBuildErrors.end() && it->second)
+	{
+	    exception_ptr buildError = it->second;
+
+	    deviceBuildErrors.erase(it);
+	    std::rethrow_exception(buildError);
+	}
+
+	ptr.reset(new DoublePendulumSimulation(device, pendulumsPerItem, precision));
+	ptr->build(result_buffer_size);
     }
 
     return *ptr;
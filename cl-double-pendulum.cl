@@ -1,79 +1,277 @@
-constant float h = 0.001f;		// time step
+#if defined(cl_khr_fp64)
+# pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
 
-constant float L1 = 0.43f;		// first rod length in the double pendulum
-constant float m1 = 1.23f;		// first mass in the double pendulum
+#if defined(cl_khr_fp16)
+# pragma OPENCL EXTENSION cl_khr_fp16 : enable
+#endif
 
-constant float L2 = 0.48f;		// second rod length in the double pendulum
-constant float m2 = 1.49f;		// second mass in the double pendulum
-constant float g  = 9.81f;
+// Simulation precision, float by default, or double or half, see DoublePendulumSimulation::get()
+#if !defined(FLOAT_TYPE)
+# define FLOAT_TYPE float
+#endif
 
-float4 stateDerivative(float4 private const *state);
-void runRungeKuttaStep(float4 private *state);
+#define VECTOR_NAME(name, width) name ## width
+#define VECTOR_TYPE_NAME(name, width) VECTOR_NAME(name, width)
 
-float4 stateDerivative(float4 private const *state)
+#define FLOAT4 VECTOR_TYPE_NAME(FLOAT_TYPE, 4)
+#define CONVERT_FLOAT4 VECTOR_TYPE_NAME(convert_, FLOAT4)
+
+// The state is integrated in the simulation precision, except for half, where the state is kept in float
+// and only the derivatives are computed in half. With the time step h, each update of the angles is far
+// below the half resolution, and would be rounded away.
+#if !defined(STATE_TYPE)
+# define STATE_TYPE FLOAT_TYPE
+#endif
+
+#define STATE4 VECTOR_TYPE_NAME(STATE_TYPE, 4)
+#define CONVERT_STATE4 VECTOR_TYPE_NAME(convert_, STATE4)
+#define STATE_VALUE(value) ((STATE_TYPE)(value))
+
+// The constants are given as float for all precisions, so all simulate the same pendulum
+#define FLOAT_VALUE(value) ((FLOAT_TYPE)(value))
+
+#if defined(cl_khr_fp64)
+# define PI STATE_VALUE(M_PI)
+#else
+# define PI STATE_VALUE(M_PI_F)
+#endif
+
+#if defined(TIME_STEP)
+// Constants given as build options, see probe_build_variants()
+# define h  FLOAT_VALUE(TIME_STEP)
+# define L1 FLOAT_VALUE(ROD_LENGTH_1)
+# define m1 FLOAT_VALUE(MASS_1)
+# define L2 FLOAT_VALUE(ROD_LENGTH_2)
+# define m2 FLOAT_VALUE(MASS_2)
+#else
+constant FLOAT_TYPE h = FLOAT_VALUE(0.001f);		// time step
+
+constant FLOAT_TYPE L1 = FLOAT_VALUE(0.43f);		// first rod length in the double pendulum
+constant FLOAT_TYPE m1 = FLOAT_VALUE(1.23f);		// first mass in the double pendulum
+
+constant FLOAT_TYPE L2 = FLOAT_VALUE(0.48f);		// second rod length in the double pendulum
+constant FLOAT_TYPE m2 = FLOAT_VALUE(1.49f);		// second mass in the double pendulum
+#endif
+
+constant FLOAT_TYPE g  = FLOAT_VALUE(9.81f);
+
+// Time step in the state precision
+#define STATE_STEP STATE_VALUE(h)
+
+// Operation count per step given by DoublePendulumSimulation::stepFlopCount, to update with the code
+STATE4 stateDerivative(STATE4 private const *state);
+void runRungeKuttaStep(STATE4 private *state);
+STATE4 initialState(void);
+
+// The derivative is computed in the simulation precision, from the state in the state precision
+STATE4 stateDerivative(STATE4 private const *state)
 {
-	private float denom = 2 * m1 + m2 - m2 * cos(2 * (*state).x - 2 * (*state).y);
+	FLOAT4 const current = CONVERT_FLOAT4(*state);
+	private FLOAT_TYPE denom = 2 * m1 + m2 - m2 * cos(2 * current.x - 2 * current.y);
 
-	return (float4)
+	FLOAT4 const derivative =
+		(FLOAT4)
 		(
-			(*state).z,
-			(*state).w,
+			current.z,
+			current.w,
 
 			(
-				-g * (2 * m1 * m2) * sin((*state).x)
+				-g * (2 * m1 + m2) * sin(current.x)
 					-
-				m2 * g * sin((*state).x - 2 * (*state).y)
+				m2 * g * sin(current.x - 2 * current.y)
 					-
-				2 * sin((*state).x - (*state).y) * m2 * ( (*state).w * (*state).w * L2 + (*state).z * (*state).z * L1 * cos((*state).x - (*state).y))
+				2 * sin(current.x - current.y) * m2 * ( current.w * current.w * L2 + current.z * current.z * L1 * cos(current.x - current.y))
 			)
 				/
 			(L1 * denom),
 
-			2 * sin((*state).x - (*state).y) * ((*state).z * (*state).z * L1 * (m1 + m2) + g * (m1 + m2) * cos((*state).x) + (*state).w * (*state).w * L2 * m2 * cos((*state).x - (*state).y))
+			2 * sin(current.x - current.y) * (current.z * current.z * L1 * (m1 + m2) + g * (m1 + m2) * cos(current.x) + current.w * current.w * L2 * m2 * cos(current.x - current.y))
 				/
 			(L2 * denom)
 		);
+
+	return CONVERT_STATE4(derivative);
 }
 
-void runRungeKuttaStep(float4 private *state)
+void runRungeKuttaStep(STATE4 private *state)
 {
-	float4 derivative_a = stateDerivative(state);
+	STATE4 derivative_a = stateDerivative(state);
 
-	float4 updated_state = *state + h / 2.0f * derivative_a;
-	float4 derivative_b = stateDerivative(&updated_state);
+	STATE4 updated_state = *state + STATE_STEP / 2 * derivative_a;
+	STATE4 derivative_b = stateDerivative(&updated_state);
 
-	updated_state = *state + h / 2.0f * derivative_b;
-	float4 derivative_c = stateDerivative(&updated_state);
+	updated_state = *state + STATE_STEP / 2 * derivative_b;
+	STATE4 derivative_c = stateDerivative(&updated_state);
 
-	updated_state = *state + h * derivative_c;
-	float4 derivative_d = stateDerivative(&updated_state);
+	updated_state = *state + STATE_STEP * derivative_c;
+	STATE4 derivative_d = stateDerivative(&updated_state);
 
 	derivative_a += 2 * (derivative_b + derivative_c) + derivative_d;
-	derivative_a *= h / 6.0f;
+	derivative_a *= STATE_STEP / 6;
 
 	*state += derivative_a;
 
-	(*state).x = fmod((*state).x, 2 * M_PI_F);
-	(*state).y = fmod((*state).y, 2 * M_PI_F);
+	(*state).x = fmod((*state).x, 2 * PI);
+	(*state).y = fmod((*state).y, 2 * PI);
 }
 
-kernel void doublePendulumSimulation(global char *result_matrix, unsigned long stepCount)
+// Start from rest, with both rods at the same angle, from 1/3 to 9/10 of pi across the work items.
+// The angle is computed as float for all precisions, as half can not hold the work item index.
+STATE4 initialState(void)
 {
-	float4 state;
+	STATE4 state;
 
 	// Read work item index as a fraction of group size from -1.0 to +1.0
 	//
-	state.x = 2.0f * get_global_id(0) / (get_global_size(0) - 1U) - 1.0f;
+	float angle = 2.0f * get_global_id(0) / (get_global_size(0) - 1U) - 1.0f;
 
 	// Translate work item index to fraction between 1/3 and 9/10 of pi
-	state.x *= (9.0f / 10.0f - 1.0f / 3.0f);
-	state.x += 1.0f / 3.0f;
-	state.x *= M_PI_F;
+	angle *= (9.0f / 10.0f - 1.0f / 3.0f);
+	angle += 1.0f / 3.0f;
+	angle *= M_PI_F;
 
+	state.x = angle;
 	state.y = state.x;
-	state.z = 0.0f;
-	state.w = 0.0f;
+	state.z = STATE_VALUE(0.0f);
+	state.w = STATE_VALUE(0.0f);
+
+	return state;
+}
+
+#if defined(ITEM_WIDTH)
+// ITEM_WIDTH (2, 4 or 8) independent pendulums for each work item, in structure of arrays form, with one
+// vector lane for each pendulum in each of the state components, see DoublePendulumSimulation::get()
+
+# define FLOAT_LANES VECTOR_TYPE_NAME(FLOAT_TYPE, ITEM_WIDTH)
+# define STATE_LANES VECTOR_TYPE_NAME(STATE_TYPE, ITEM_WIDTH)
+# define FLOAT_ANGLES VECTOR_TYPE_NAME(float, ITEM_WIDTH)
+# define CONVERT_LANES VECTOR_TYPE_NAME(convert_, FLOAT_LANES)
+# define CONVERT_STATE_LANES VECTOR_TYPE_NAME(convert_, STATE_LANES)
+
+# if ITEM_WIDTH == 2
+#  define LANE_INDEX ((FLOAT_ANGLES)(0.0f, 1.0f))
+# elif ITEM_WIDTH == 4
+#  define LANE_INDEX ((FLOAT_ANGLES)(0.0f, 1.0f, 2.0f, 3.0f))
+# elif ITEM_WIDTH == 8
+#  define LANE_INDEX ((FLOAT_ANGLES)(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f))
+# else
+#  error "ITEM_WIDTH should be 2, 4 or 8"
+# endif
+
+typedef struct
+{
+	STATE_LANES theta1, theta2, omega1, omega2;
+}
+	PendulumLanes;
+
+PendulumLanes lanesDerivative(PendulumLanes private const *state);
+PendulumLanes lanesUpdate(PendulumLanes private const *state, STATE_TYPE step, PendulumLanes private const *derivative);
+void runRungeKuttaLanesStep(PendulumLanes private *state);
+PendulumLanes initialLanesState(void);
+
+// Same as stateDerivative(), for all the lanes at once
+PendulumLanes lanesDerivative(PendulumLanes private const *state)
+{
+	FLOAT_LANES const
+		theta1 = CONVERT_LANES(state->theta1), theta2 = CONVERT_LANES(state->theta2),
+		omega1 = CONVERT_LANES(state->omega1), omega2 = CONVERT_LANES(state->omega2);
+	FLOAT_LANES denom = 2 * m1 + m2 - m2 * cos(2 * theta1 - 2 * theta2);
+	PendulumLanes derivative;
+
+	derivative.theta1 = state->omega1;
+	derivative.theta2 = state->omega2;
+
+	derivative.omega1 = CONVERT_STATE_LANES
+		(
+			(
+				-g * (2 * m1 + m2) * sin(theta1)
+					-
+				m2 * g * sin(theta1 - 2 * theta2)
+					-
+				2 * sin(theta1 - theta2) * m2 * (omega2 * omega2 * L2 + omega1 * omega1 * L1 * cos(theta1 - theta2))
+			)
+				/
+			(L1 * denom)
+		);
+
+	derivative.omega2 = CONVERT_STATE_LANES
+		(
+			2 * sin(theta1 - theta2) * (omega1 * omega1 * L1 * (m1 + m2) + g * (m1 + m2) * cos(theta1) + omega2 * omega2 * L2 * m2 * cos(theta1 - theta2))
+				/
+			(L2 * denom)
+		);
+
+	return derivative;
+}
+
+PendulumLanes lanesUpdate(PendulumLanes private const *state, STATE_TYPE step, PendulumLanes private const *derivative)
+{
+	PendulumLanes updated_state;
+
+	updated_state.theta1 = state->theta1 + step * derivative->theta1;
+	updated_state.theta2 = state->theta2 + step * derivative->theta2;
+	updated_state.omega1 = state->omega1 + step * derivative->omega1;
+	updated_state.omega2 = state->omega2 + step * derivative->omega2;
+
+	return updated_state;
+}
+
+void runRungeKuttaLanesStep(PendulumLanes private *state)
+{
+	PendulumLanes derivative_a = lanesDerivative(state);
+
+	PendulumLanes updated_state = lanesUpdate(state, STATE_STEP / 2, &derivative_a);
+	PendulumLanes derivative_b = lanesDerivative(&updated_state);
+
+	updated_state = lanesUpdate(state, STATE_STEP / 2, &derivative_b);
+	PendulumLanes derivative_c = lanesDerivative(&updated_state);
+
+	updated_state = lanesUpdate(state, STATE_STEP, &derivative_c);
+	PendulumLanes derivative_d = lanesDerivative(&updated_state);
+
+	state->theta1 += STATE_STEP / 6 * (derivative_a.theta1 + 2 * (derivative_b.theta1 + derivative_c.theta1) + derivative_d.theta1);
+	state->theta2 += STATE_STEP / 6 * (derivative_a.theta2 + 2 * (derivative_b.theta2 + derivative_c.theta2) + derivative_d.theta2);
+	state->omega1 += STATE_STEP / 6 * (derivative_a.omega1 + 2 * (derivative_b.omega1 + derivative_c.omega1) + derivative_d.omega1);
+	state->omega2 += STATE_STEP / 6 * (derivative_a.omega2 + 2 * (derivative_b.omega2 + derivative_c.omega2) + derivative_d.omega2);
+
+	state->theta1 = fmod(state->theta1, (STATE_LANES)(2 * PI));
+	state->theta2 = fmod(state->theta2, (STATE_LANES)(2 * PI));
+}
+
+// Same as initialState(), with the pendulums of all work items spread over the same angle range
+PendulumLanes initialLanesState(void)
+{
+	PendulumLanes state;
+	FLOAT_ANGLES angle = 2.0f * ((FLOAT_ANGLES)(get_global_id(0) * ITEM_WIDTH) + LANE_INDEX) / (get_global_size(0) * ITEM_WIDTH - 1U) - 1.0f;
+
+	angle *= (9.0f / 10.0f - 1.0f / 3.0f);
+	angle += 1.0f / 3.0f;
+	angle *= M_PI_F;
+
+	state.theta1 = CONVERT_STATE_LANES(angle);
+	state.theta2 = state.theta1;
+	state.omega1 = STATE_VALUE(0.0f);
+	state.omega2 = STATE_VALUE(0.0f);
+
+	return state;
+}
 
+kernel void doublePendulumSimulation(global char *result_matrix, unsigned long stepCount)
+{
+	PendulumLanes state = initialLanesState();
+	unsigned long i = 0;
+
+	for (i = 0; i < stepCount; i++)
+		runRungeKuttaLanesStep(&state);
+
+	if (get_global_id(0) % 128 == 0)
+		result_matrix[get_global_id(0) / 128] = state.theta1.s0 * 10;
+}
+#else
+kernel void doublePendulumSimulation(global char *result_matrix, unsigned long stepCount)
+{
+	STATE4 state = initialState();
 	unsigned long i = 0;
 
 	for (i = 0; i < stepCount; i++)
@@ -82,3 +280,18 @@ kernel void doublePendulumSimulation(global char *result_matrix, unsigned long s
 	if (get_global_id(0) % 128 == 0)
 		result_matrix[get_global_id(0) / 128] = state.x * 10;
 }
+#endif
+
+// Initial and final state of each work item, for the energy drift of the integration
+kernel void doublePendulumState(global STATE4 *states, unsigned long stepCount)
+{
+	STATE4 state = initialState();
+	unsigned long i = 0;
+
+	states[get_global_id(0)] = state;
+
+	for (i = 0; i < stepCount; i++)
+		runRungeKuttaStep(&state);
+
+	states[get_global_size(0) + get_global_id(0)] = state;
+}
@@ -5,6 +5,10 @@
 #include <chrono>
 #include <memory>
 #include <array>
+#include <vector>
+#include <functional>
+#include <utility>
+#include <string>
 
 #if defined(__APPLE__) || defined(__MACOSX__)
 # include <OpenCL/cl2.hpp>
@@ -20,6 +24,18 @@
 	using KernelFunction = cl::make_kernel<Ts...>;
 #endif
 
+char const *pendulumProgramFile();
+std::string pendulumProgramSource();
+
+// Floating-point type for the simulation, see FLOAT_TYPE in cl-double-pendulum.cl. The half simulation
+// computes the derivatives in half, and keeps the state in float, see STATE_TYPE.
+enum class SimulationPrecision
+{
+    Half, Single, Double
+};
+
+char const *simulationPrecisionName(SimulationPrecision precision);
+
 extern void CL_CALLBACK context_error_notification(char const *error_info, void const *private_info, size_t private_info_size, void *user_data);
 
 class DoublePendulumSimulation
@@ -40,19 +56,44 @@ protected:
 
     cl::Buffer		result;
     cl_ulong	    	iterCount = 0;
+    unsigned		itemWidth = 1u;
+    SimulationPrecision precision = SimulationPrecision::Single;
 
     void build(std::size_t result_buffer_size);
-    DoublePendulumSimulation(cl::Device &device);
+    DoublePendulumSimulation(cl::Device &device, unsigned itemWidth = 1u, SimulationPrecision precision = SimulationPrecision::Single);
 
 public:
+    // Floating-point operations for one pendulum in one runRungeKuttaStep(), counted as written in the kernel
+    // source, with each sin, cos, fmod and division as one operation, and without the constant products:
+    // 48 for each of the four stateDerivative() calls, 24 for the three intermediate states, and 26 for the
+    // weighted sum of the derivatives, the state update and the angle wrap
+    static cl_ulong const stepFlopCount = 242u;
+
     void probeIterationCount(std::chrono::milliseconds targetDurationMs);
-    unsigned long runSimulation(cl::NDRange const &globalSize, cl::NDRange const &localSize);
+    // Kernel execution time in nanoseconds, from the profiling events
+    cl_ulong runSimulation(cl::NDRange const &globalSize, cl::NDRange const &localSize);
 
     std::size_t groupSizeMultiple() const;
     std::size_t workGroupSize() const;
     cl_ulong iterationCount() const;
-
-    static DoublePendulumSimulation &get(cl::Device &device);
+    unsigned pendulumsPerItem() const;
+    SimulationPrecision floatPrecision() const;
+
+    // Simulation with the given number of pendulums (1, 2, 4 or 8) integrated by each work item, as vector
+    // lanes, and the given precision, built on first use for the device
+    static DoublePendulumSimulation &get(cl::Device &device, unsigned pendulumsPerItem = 1u, SimulationPrecision precision = SimulationPrecision::Single);
+
+    // Double needs CL_DEVICE_DOUBLE_FP_CONFIG, and half needs cl_khr_fp16
+    static bool hasPrecision(cl::Device const &device, SimulationPrecision precision);
+
+    // Build the given simulations, by precision and pendulum count per work item, for all the devices at once,
+    // one thread for each simulation on each device, for get() to return later. Precisions not supported by
+    // a device are skipped. Build errors are reported by get() for the device and simulation.
+    static void buildAll
+	(
+	    std::vector<std::reference_wrapper<cl::Device>> const &devices,
+	    std::vector<std::pair<SimulationPrecision, unsigned>> const &simulations = { { SimulationPrecision::Single, 1u } }
+	);
 };
 
 inline std::size_t DoublePendulumSimulation::groupSizeMultiple() const
@@ -70,4 +111,14 @@ inline cl_ulong DoublePendulumSimulation::iterationCount() const
     return iterCount;
 }
 
+inline unsigned DoublePendulumSimulation::pendulumsPerItem() const
+{
+    return itemWidth;
+}
+
+inline SimulationPrecision DoublePendulumSimulation::floatPrecision() const
+{
+    return precision;
+}
+
 #endif // !defined(CL_DOUBLE_PENDULUM_HH)
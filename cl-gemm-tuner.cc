@@ -0,0 +1,296 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "cl-platform-info.hh"
+#include "cl-matrix-mult.hh"
+#include "cl-gemm-tuner.hh"
+
+using std::size_t;
+using std::uint64_t;
+using std::getenv;
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+using std::istringstream;
+using std::ostringstream;
+using std::clog;
+using std::endl;
+using std::flush;
+using std::hex;
+using std::setw;
+using std::setprecision;
+using std::fixed;
+
+using cl::Error;
+using cl::Context;
+using cl::Device;
+using cl::CommandQueue;
+using cl::Buffer;
+using cl::EnqueueArgs;
+using cl::Event;
+
+namespace filesystem = std::filesystem;
+
+// Tiled multiply size used to time each kernel shape, large enough to fill the device with work groups
+static cl::size_type const TUNING_MATRIX_SIZE = 1024u;
+static unsigned const TUNING_PASS_COUNT = 3u;
+
+extern string user_cache_directory()
+{
+#if defined(_WINDOWS)
+    char const *cacheHome = getenv("LOCALAPPDATA");
+
+    if (cacheHome && *cacheHome)
+	return string(cacheHome) + "\\cl-tool";
+#else
+    char const *cacheHome = getenv("XDG_CACHE_HOME");
+
+    if (cacheHome && *cacheHome)
+	return string(cacheHome) + "/cl-tool";
+
+    char const *home = getenv("HOME");
+
+    if (home && *home)
+	return string(home) + "/.cache/cl-tool";
+#endif
+
+    return ".cl-tool-cache";
+}
+
+// 64-bit FNV-1a hash, stable across compilers and runs, unlike std::hash
+extern uint64_t source_hash(string const &text)
+{
+    uint64_t hash = 0xCBF29CE484222325u;
+
+    for (unsigned char ch: text)
+    {
+	hash ^= ch;
+	hash *= 0x00000100000001B3u;
+    }
+
+    return hash;
+}
+
+extern string gemm_tuning_file_name()
+{
+    return (filesystem::path(user_cache_directory()) / "gemm-tuning.txt").string();
+}
+
+// One line in the tuning file per device, driver, kernel source and element type, tab separated
+static string gemm_config_key(Device const &device, char const *typeName, string const &kernelSource)
+{
+    ostringstream key;
+
+    key << trim_name(device.getInfo<CL_DEVICE_NAME>()) << '\t' << trim_name(device.getInfo<CL_DRIVER_VERSION>()) << '\t'
+	<< hex << setw(16) << std::setfill('0') << source_hash(kernelSource) << '\t' << typeName << '\t';
+
+    return key.str();
+}
+
+extern bool load_gemm_config(Device const &device, char const *typeName, string const &kernelSource, GemmConfig &config)
+{
+    ifstream tuningFile(gemm_tuning_file_name());
+    string const key = gemm_config_key(device, typeName, kernelSource);
+    string line;
+
+    while (std::getline(tuningFile, line))
+	if (!line.compare(0, key.length(), key))
+	{
+	    istringstream values(line.substr(key.length()));
+	    GemmConfig tunedConfig;
+
+	    if (values >> tunedConfig.tileSize >> tunedConfig.workPerItem >> tunedConfig.vectorWidth >> tunedConfig.unroll)
+	    {
+		config = tunedConfig;
+		return true;
+	    }
+	}
+
+    return false;
+}
+
+extern void save_gemm_config(Device const &device, char const *typeName, string const &kernelSource, GemmConfig const &config)
+{
+    string const key = gemm_config_key(device, typeName, kernelSource), fileName = gemm_tuning_file_name();
+    vector<string> lines;
+
+    {
+	ifstream tuningFile(fileName);
+	string line;
+
+	while (std::getline(tuningFile, line))
+	    if (!line.empty() && line.compare(0, key.length(), key))
+		lines.push_back(line);
+    }
+
+    filesystem::create_directories(filesystem::path(fileName).parent_path());
+
+    ofstream tuningFile(fileName, ofstream::trunc);
+
+    tuningFile.exceptions(tuningFile.exceptions() | tuningFile.badbit | tuningFile.failbit);
+
+    for (auto const &line: lines)
+	tuningFile << line << '\n';
+
+    tuningFile << key << config.tileSize << ' ' << config.workPerItem << ' ' << config.vectorWidth << ' ' << config.unroll << endl;
+}
+
+// Check the kernel shape against the device limits, before building the kernels
+static bool fits_device(Device const &device, GemmConfig const &config)
+{
+    auto const maxItemSizes = device.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES>();
+    cl::size_type const *localSize = config.localSize();
+
+    return
+	config.tileSize % config.colsPerItem() == 0 && config.tileSize % config.workPerItem == 0
+	    &&
+	config.workGroupSize() <= device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>()
+	    &&
+	localSize[0] <= maxItemSizes[0] && localSize[1] <= maxItemSizes[1]
+	    &&
+	2u * config.tileSize * config.tileSize * sizeof(cl_float) <= device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+}
+
+// Build the kernels for the given shape and return the multiply speed in GFLOPS, or 0 if the shape
+// does not fit the compiled kernel limits
+static double time_gemm_config(Context &context, Device &device, CommandQueue &queue, Buffer &m, Buffer &n, Buffer &result, GemmConfig const &config)
+try
+{
+    cl::size_type const size = TUNING_MATRIX_SIZE;
+    MatrixKernels<cl_float> kernels(context, config);
+    cl::Kernel multiplyKernel = kernels.multiply_matrix_tile.getKernel();
+
+    if
+	(
+	    config.workGroupSize() > multiplyKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device)
+		||
+	    multiplyKernel.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(device) > device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>()
+	)
+    {
+	return 0.0;
+    }
+
+    EnqueueArgs const multiplyArgs(queue, kernels.globalSize(size, size), kernels.localSize());
+    cl_ulong totalTime = 0u;
+
+    kernels.multiply_matrix_tile(multiplyArgs, m, false, n, false, result, size, size, size, 1.0f, 0.0f);
+    queue.finish();
+
+    for (unsigned pass = 0u; pass < TUNING_PASS_COUNT; pass++)
+    {
+	Event event = kernels.multiply_matrix_tile(multiplyArgs, m, false, n, false, result, size, size, size, 1.0f, 0.0f);
+	queue.finish();
+
+	totalTime += event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    }
+
+    return totalTime ? 2.0 * size * size * size * TUNING_PASS_COUNT / static_cast<double>(totalTime) : 0.0;
+}
+catch (Error const &error)
+{
+    return 0.0;
+}
+
+static void show_gemm_config(GemmConfig const &config, double gflops)
+{
+    clog << "\r\tTile " << setw(2) << config.tileSize << ", work per item " << config.workPerItem << ", vector width " << setw(2) << config.vectorWidth
+	 << ", unroll " << setw(2) << config.unroll << ": " << setw(10) << fixed << setprecision(2) << gflops << " GFLOPS" << endl;
+}
+
+// Search the tile size, work per item and vector width first, then the unroll count for the best shape.
+// Save and return the fastest shape.
+extern GemmConfig tune_gemm(Device &device)
+{
+    static cl::size_type const tileSizes[] = { 16u, 32u, 64u }, workPerItemValues[] = { 1u, 2u, 4u, 8u };
+    static cl_uint const vectorWidths[] = { 1u, 2u, 4u, 8u, 16u }, unrollCounts[] = { 2u, 4u, 8u, 16u };
+
+    cl::size_type const size = TUNING_MATRIX_SIZE;
+    Context context(device);
+    CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    Buffer
+	m(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, sizeof(cl_float) * size * size),
+	n(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, sizeof(cl_float) * size * size),
+	result(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, sizeof(cl_float) * size * size);
+
+    GemmConfig bestConfig = Matrix::defaultGemmConfig(device, 32u, 4u, 1u);
+    double bestSpeed = 0.0;
+
+    {
+	MatrixKernels<cl_float> kernels(context, bestConfig);
+
+	kernels.random_fill_block(EnqueueArgs(queue, kernels.randomFillSize(size, size)), m, size, size, -100.0f, 100.0f, 0u, 0u);
+	kernels.random_fill_block(EnqueueArgs(queue, kernels.randomFillSize(size, size)), n, size, size, -100.0f, 100.0f, 0u, 1u);
+	queue.enqueueFillBuffer<cl_float>(result, 0.0f, 0u, sizeof(cl_float) * size * size);
+	queue.finish();
+    }
+
+    clog << "\tTuning matrix multiplication for " << size << 'x' << size << " float matrices" << endl;
+
+    for (auto tileSize: tileSizes)
+	for (auto workPerItem: workPerItemValues)
+	    for (auto vectorWidth: vectorWidths)
+	    {
+		GemmConfig const config { tileSize, workPerItem, vectorWidth, 1u };
+
+		if (fits_device(device, config))
+		{
+		    clog << "\r\tTile " << setw(2) << tileSize << ", work per item " << workPerItem << ", vector width " << setw(2) << vectorWidth << "..." << flush;
+
+		    double const speed = time_gemm_config(context, device, queue, m, n, result, config);
+
+		    if (speed > bestSpeed)
+		    {
+			bestSpeed = speed;
+			bestConfig = config;
+			show_gemm_config(config, speed);
+		    }
+		}
+	    }
+
+    for (auto unroll: unrollCounts)
+    {
+	GemmConfig config = bestConfig;
+
+	config.unroll = unroll;
+
+	clog << "\r\tUnroll " << setw(2) << unroll << "...                                        " << flush;
+
+	double const speed = time_gemm_config(context, device, queue, m, n, result, config);
+
+	if (speed > bestSpeed)
+	{
+	    bestSpeed = speed;
+	    bestConfig = config;
+	    show_gemm_config(config, speed);
+	}
+    }
+
+    clog << "\r                                                            \r";
+
+    if (bestSpeed > 0.0)
+    {
+	save_gemm_config(device, MatrixKernels<cl_float>::typeName(), matrixProgramSource(), bestConfig);
+	clog << "\tBest configuration:" << endl;
+	show_gemm_config(bestConfig, bestSpeed);
+	clog << "\tSaved to " << gemm_tuning_file_name() << endl;
+    }
+    else
+	clog << "\tNo matrix multiplication kernel could run on the device." << endl;
+
+    return bestConfig;
+}
@@ -0,0 +1,24 @@
+#if !defined(CL_GEMM_TUNER_HH)
+#define CL_GEMM_TUNER_HH
+
+#include <cstdint>
+#include <string>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "cl-matrix-mult.hh"
+
+extern std::string user_cache_directory();
+extern std::uint64_t source_hash(std::string const &text);
+
+extern std::string gemm_tuning_file_name();
+extern bool load_gemm_config(cl::Device const &device, char const *typeName, std::string const &kernelSource, GemmConfig &config);
+extern void save_gemm_config(cl::Device const &device, char const *typeName, std::string const &kernelSource, GemmConfig const &config);
+
+extern GemmConfig tune_gemm(cl::Device &device);
+
+#endif // !defined(CL_GEMM_TUNER_HH)
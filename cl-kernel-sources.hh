@@ -0,0 +1,18 @@
+#if !defined(CL_KERNEL_SOURCES_HH)
+#define CL_KERNEL_SOURCES_HH
+
+#include <cstddef>
+
+// OpenCL source file built into the executable, see EmbedOpenCLSources.cmake
+struct EmbeddedSource
+{
+    char const	       *fileName;
+    char const	       *text;
+    std::size_t		length;
+};
+
+// Defined in the generated cl-kernel-sources.cc, in the build directory
+extern EmbeddedSource const embedded_sources[];
+extern std::size_t const embedded_source_count;
+
+#endif // !defined(CL_KERNEL_SOURCES_HH)
@@ -1,25 +1,58 @@
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
+#include "cl-platform-info.hh"
 #include "cl-matrix-mult.hh"
+#include "cl-gemm-tuner.hh"
+#include "cl-program-cache.hh"
+#include "cl-kernel-sources.hh"
 
+using std::size_t;
+using std::getenv;
+using std::strcmp;
 using std::string;
+using std::vector;
+using std::reference_wrapper;
+using std::thread;
 using std::ifstream;
+using std::istringstream;
 using std::ostringstream;
-using std::cerr;
-using std::endl;
 
 using cl::Error;
 using cl::Context;
+using cl::Device;
 using cl::Program;
 using cl::QueueProperties;
 
+namespace filesystem = std::filesystem;
+
+// The OpenCL sources are built into the executable, see EmbedOpenCLSources.cmake. For kernel development,
+// CL_TOOL_KERNEL_DIR names a directory to read them from instead, without rebuilding.
 string readSourceFile(char const *file_name)
 {
-    ifstream sourceFile(file_name);
+    char const *kernelDir = getenv("CL_TOOL_KERNEL_DIR");
+
+    if (!kernelDir || !*kernelDir)
+    {
+	for (size_t i = 0u; i < embedded_source_count; i++)
+	    if (!strcmp(embedded_sources[i].fileName, file_name))
+		return string(embedded_sources[i].text, embedded_sources[i].length);
+
+	throw std::invalid_argument(string("No OpenCL source ") + file_name + " built into the executable");
+    }
+
+    ifstream sourceFile(filesystem::path(kernelDir) / file_name);
     ostringstream sourceText;
 
     sourceFile.exceptions(sourceFile.exceptions() | sourceFile.badbit | sourceFile.failbit);
@@ -28,7 +61,7 @@ string readSourceFile(char const *file_name)
     return sourceText.str();
 }
 
-static char const program_file_name[] = "./cl-matrix-rand.cl";
+static char const program_file_name[] = "cl-matrix-rand.cl";
 
 enum class FloatType { Half, Single, Double, Quad };
 
@@ -49,40 +82,346 @@ char const *float_type_name(FloatType floatType)
     return "-";
 }
 
-static Program &build_program(Program &program, FloatType floatType)
-try
+// Build options selecting the element type in the kernel source, see FLOAT_TYPE and SCALAR_TYPE
+static string float_type_options(FloatType floatType)
+{
+    switch (floatType)
+    {
+	case FloatType::Half:
+	    return "-DFLOAT_TYPE=half -DSCALAR_TYPE=float";
+	case FloatType::Single:
+	    return "-DFLOAT_TYPE=float -DSCALAR_TYPE=float";
+	case FloatType::Double:
+	    return "-DFLOAT_TYPE=double -DSCALAR_TYPE=double -DRANDOM_DOUBLE";
+	case FloatType::Quad:
+	    return "-DFLOAT_TYPE=quad -DSCALAR_TYPE=double -DDOUBLE_DOUBLE -DRANDOM_DOUBLE";
+    }
+
+    return string();
+}
+
+// Full compiler options for the kernel source, with the kernel shape. The spirv target in CMakeLists.txt
+// compiles a module with the options for the default float kernels, that must match these.
+static string program_options(string const &buildOptions, GemmConfig const &config, char const *languageVersion = "CL1.1")
+{
+    return
+	string("-cl-std=") + languageVersion + " " + buildOptions
+	    + " -DTILE_SIZE=" + std::to_string(config.tileSize) + " -DWORK_PER_ITEM=" + std::to_string(config.workPerItem)
+	    + " -DVECTOR_WIDTH=" + std::to_string(config.vectorWidth) + " -DUNROLL=" + std::to_string(config.unroll);
+}
+
+static Program build_program(Context const &context, string const &buildOptions, GemmConfig const &config, char const *languageVersion = "CL1.1")
+{
+    return build_file_program(context, program_file_name, program_options(buildOptions, config, languageVersion));
+}
+
+char const *matrixProgramFile()
+{
+    return program_file_name;
+}
+
+string matrixProgramSource()
+{
+    return readSourceFile(program_file_name);
+}
+
+template<typename ElementType>
+    static FloatType float_type();
+
+template<>
+    FloatType float_type<cl_float>()
+{
+    return FloatType::Single;
+}
+
+template<>
+    FloatType float_type<cl_double>()
+{
+    return FloatType::Double;
+}
+
+template<>
+    FloatType float_type<cl_half>()
+{
+    return FloatType::Half;
+}
+
+template<>
+    FloatType float_type<QuadFloat>()
+{
+    return FloatType::Quad;
+}
+
+template<typename FloatType>
+    char const *MatrixKernels<FloatType>::typeName()
+{
+    return float_type_name(float_type<FloatType>());
+}
+
+// Work group lines and columns for the batched products, that fit the work group size of all devices
+static cl::size_type batch_tile_size(Context const &context)
+{
+    cl::size_type batchTile = 16u;
+
+    for (auto const &device: context.getInfo<CL_CONTEXT_DEVICES>())
+	while (batchTile > 1u && batchTile * batchTile > device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>())
+	    batchTile /= 2u;
+
+    return batchTile;
+}
+
+template<typename FloatType>
+    MatrixKernels<FloatType>::MatrixKernels(Context &context, GemmConfig const &config, string const &buildOptions)
+	: GemmConfig(config),
+	  batchTile(batch_tile_size(context)),
+	  program(build_file_program(context, program_file_name, programOptions(context, config, buildOptions))),
+	  random_fill_block(program, string("random_fill_") + typeName() + "_block"),
+	  multiply_matrix_block(program, string("multiply_") + typeName() + "_matrix_block"),
+	  multiply_matrix_tile(program, string("multiply_") + typeName() + "_matrix_tile"),
+	  multiply_half_tile(program, string("multiply_") + typeName() + "_half_tile"),
+	  convert_to_half(program, string("convert_") + typeName() + "_to_half"),
+	  multiply_batch_item(program, string("multiply_") + typeName() + "_batch_item"),
+	  multiply_batch_group(program, string("multiply_") + typeName() + "_batch_group"),
+	  matrix_add(program, string("matrix_") + typeName() + "_add")
+{
+}
+
+template<typename FloatType>
+    string MatrixKernels<FloatType>::programOptions(Context const &context, GemmConfig const &config, string const &buildOptions)
+{
+    return program_options
+	(
+	    float_type_options(float_type<FloatType>()) + " -DBATCH_TILE=" + std::to_string(batch_tile_size(context)) + (buildOptions.empty() ? "" : " " + buildOptions),
+	    config
+	);
+}
+
+template struct MatrixKernels<cl_float>;
+template struct MatrixKernels<cl_double>;
+template struct MatrixKernels<cl_half>;
+template struct MatrixKernels<QuadFloat>;
+
+template<>
+    char const *IntegerKernels<cl_char>::typeName()
+{
+    return "char";
+}
+
+template<>
+    char const *IntegerKernels<cl_short>::typeName()
 {
-    program.build((string("-cl-std=CL1.1 -DFLOAT_TYPE=") + float_type_name(floatType)).c_str());
+    return "short";
+}
 
-    return program;
+// Build options selecting the integer element type in the kernel source, see INTEGER_TYPE
+template<typename IntegerType>
+    static string integer_type_options()
+{
+    return string("-DINTEGER_TYPE=") + IntegerKernels<IntegerType>::typeName() + " -DINTEGER_BITS=" + std::to_string(sizeof(IntegerType) * 8u);
 }
-catch(Error const &error)
+
+// The dot product built-ins of cl_khr_integer_dot_product are only declared for OpenCL C 3.0
+template<typename IntegerType>
+    IntegerKernels<IntegerType>::IntegerKernels(Context &context, GemmConfig const &config, bool dotProduct)
+	: GemmConfig(config),
+	  program(build_program(context, integer_type_options<IntegerType>(), config, dotProduct ? "CL3.0" : "CL1.1")),
+	  random_fill_block(program, string("random_fill_") + typeName() + "_block"),
+	  multiply_tile(program, string("multiply_") + typeName() + "_tile")
 {
-    if (error.err() == CL_BUILD_PROGRAM_FAILURE)
+}
+
+template struct IntegerKernels<cl_char>;
+template struct IntegerKernels<cl_short>;
+
+// Vector width for the kernels of one element type: the given width if any, or the device preferred
+// width, for the scalar, 2, 4, 8 and 16 element vector variants of the kernels
+static cl_uint select_vector_width(cl_uint preferredWidth, cl_uint vectorWidth)
+{
+    if (!vectorWidth)
+	vectorWidth = preferredWidth;
+
+    switch (vectorWidth)
+    {
+	case 0u:
+	    return 1u;
+	case 1u:
+	case 2u:
+	case 4u:
+	case 8u:
+	case 16u:
+	    return vectorWidth;
+    }
+
+    throw std::invalid_argument("Unsupported vector width " + std::to_string(vectorWidth) + " for matrix multiplication (use 1, 2, 4, 8 or 16)");
+}
+
+// Kernel shape used without a tuned configuration, with the tile reduced as needed to fit the work
+// group size of the device
+GemmConfig Matrix::defaultGemmConfig(Device const &device, cl::size_type tileSize, cl::size_type workPerItem, cl_uint vectorWidth)
+{
+    GemmConfig config { tileSize, workPerItem, vectorWidth, 1u };
+    cl::size_type const maxGroupSize = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+
+    while (config.workGroupSize() > maxGroupSize && config.tileSize > config.colsPerItem() && config.tileSize > config.workPerItem)
+	config.tileSize /= 2u;
+
+    return config;
+}
+
+// Tuned kernel shape for the float kernels if available, with the vector width from the command line
+// if given, or a default shape for the device
+static GemmConfig float_gemm_config(Device const &device, cl_uint vectorWidth)
+{
+    GemmConfig config;
+
+    if (load_gemm_config(device, MatrixKernels<cl_float>::typeName(), matrixProgramSource(), config))
     {
-#if defined(CL_HPP_PARAM_NAME_INFO_1_0_)
-	auto const buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>();
-
-	if (!buildLog.empty())
-	    for (auto const &output_msg: buildLog)
-		cerr << "Build output from device " << output_msg.first.getInfo<CL_DEVICE_NAME>() << ":\n\t" << output_msg.second << endl;
-#else
-	string deviceBuildLog;
-
-	program.getInfo(CL_PROGRAM_BUILD_LOG, &deviceBuildLog);
-	cerr << "Build output:\n" << deviceBuildLog;
-#endif
+	if (vectorWidth)
+	    config.vectorWidth = select_vector_width(vectorWidth, vectorWidth);
+
+	return config;
     }
 
+    return Matrix::defaultGemmConfig(device, 32u, 4u, select_vector_width(device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT>(), vectorWidth));
+}
+
+// Default kernel shape for the double kernels, with the vector width from the command line if given
+static GemmConfig double_gemm_config(Device const &device, cl_uint vectorWidth)
+{
+    return Matrix::defaultGemmConfig(device, 32u, 4u, select_vector_width(device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE>(), vectorWidth));
+}
+
+// The device compiles OpenCL C 3.0, that all OpenCL 3.0 devices support
+static bool has_opencl_c_3(Device const &device)
+{
+    // "OpenCL <major>.<minor> <platform-specific information>"
+    istringstream version(device.getInfo<CL_DEVICE_VERSION>().substr(sizeof "OpenCL"));
+    unsigned major = 0u;
+
+    version >> major;
 
-    throw;
+    return major >= 3u;
 }
 
-Matrix::Matrix(Context &context)
-    : cmdQueue(::clCreateCommandQueue(context(), context.getInfo<CL_CONTEXT_DEVICES>()[0](), 0 /* QueueProperties::OutOfOrder */, nullptr), true),
-      program(context, readSourceFile(program_file_name), false),
-      random_fill_float_block(build_program(program, FloatType::Single), "random_fill_float_block"),
-      multiply_float_matrix_block(program, "multiply_float_matrix_block") //,
-      // random_fill_double_block(program, "random_fill_double_block")
+// Add out-of-order execution to the queue properties, if the device supports it
+static cl_command_queue_properties out_of_order_queue(Device const &device, cl_command_queue_properties queueProperties)
 {
+    return queueProperties | (device.getInfo<CL_DEVICE_QUEUE_PROPERTIES>() & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+}
+
+Matrix::Matrix(Context &context, cl_uint vectorWidth, cl_command_queue_properties queueProperties)
+    : context(context),
+      device(context.getInfo<CL_CONTEXT_DEVICES>()[0]),
+      vectorWidthOverride(vectorWidth),
+      hasFp64(device.getInfo<CL_DEVICE_DOUBLE_FP_CONFIG>() != 0),
+      hasFp16(has_extension(device.getInfo<CL_DEVICE_EXTENSIONS>(), "cl_khr_fp16")),
+      hostUnifiedMemory(device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>() != CL_FALSE),
+      cmdQueue(::clCreateCommandQueue(context(), device(), out_of_order_queue(device, queueProperties), nullptr), true),
+      floatKernels(context, float_gemm_config(device, vectorWidth)),
+      hasIntegerDotProduct(has_extension(device.getInfo<CL_DEVICE_EXTENSIONS>(), "cl_khr_integer_dot_product") && has_opencl_c_3(device))
+{
+}
+
+// The programs are built in a context of their own for each device, only for the program cache to hold the
+// device binaries by the time the Matrix for the device is created. Build errors are left for the Matrix
+// to report, when it builds the same program again.
+void Matrix::buildAll(vector<reference_wrapper<Device>> const &devices, cl_uint vectorWidth)
+{
+    vector<thread> buildThreads;
+
+    for (Device &device: devices)
+	buildThreads.emplace_back([&device, vectorWidth]()
+	    {
+		try
+		{
+		    Context context(device);
+
+		    build_file_program(context, program_file_name, MatrixKernels<cl_float>::programOptions(context, float_gemm_config(device, vectorWidth)));
+
+		    if (device.getInfo<CL_DEVICE_DOUBLE_FP_CONFIG>())
+			build_file_program(context, program_file_name, MatrixKernels<cl_double>::programOptions(context, double_gemm_config(device, vectorWidth)));
+		}
+		catch (...)
+		{
+		}
+	    });
+
+    for (thread &buildThread: buildThreads)
+	buildThread.join();
+}
+
+template<>
+    MatrixKernels<cl_double> &Matrix::kernels<cl_double>()
+{
+    if (!doubleKernels)
+    {
+	if (!hasFp64)
+	    throw std::runtime_error("Double precision is not supported by device " + device.getInfo<CL_DEVICE_NAME>());
+
+	doubleKernels.reset
+	    (
+		new MatrixKernels<cl_double>
+		    (
+			context,
+			double_gemm_config(device, vectorWidthOverride)
+		    )
+	    );
+    }
+
+    return *doubleKernels;
+}
+
+template<>
+    MatrixKernels<cl_half> &Matrix::kernels<cl_half>()
+{
+    if (!halfKernels)
+    {
+	if (!hasFp16)
+	    throw std::runtime_error("Half precision (cl_khr_fp16) is not supported by device " + device.getInfo<CL_DEVICE_NAME>());
+
+	halfKernels.reset
+	    (
+		new MatrixKernels<cl_half>
+		    (
+			context,
+			defaultGemmConfig(device, 32u, 4u, select_vector_width(device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_HALF>(), vectorWidthOverride))
+		    )
+	    );
+    }
+
+    return *halfKernels;
+}
+
+// Double-double arithmetic has no vector variant, and twice the local memory per tile element
+template<>
+    MatrixKernels<QuadFloat> &Matrix::kernels<QuadFloat>()
+{
+    if (!quadKernels)
+    {
+	if (!hasFp64)
+	    throw std::runtime_error("Emulated quad precision needs double precision, not supported by device " + device.getInfo<CL_DEVICE_NAME>());
+
+	quadKernels.reset(new MatrixKernels<QuadFloat>(context, defaultGemmConfig(device, 16u, 2u, 1u)));
+    }
+
+    return *quadKernels;
+}
+
+// The integer kernels take 4 elements along the inner dimension at a time, with no vectors across columns
+template<>
+    IntegerKernels<cl_char> &Matrix::integerKernels<cl_char>()
+{
+    if (!charKernels)
+	charKernels.reset(new IntegerKernels<cl_char>(context, defaultGemmConfig(device, 32u, 4u, 1u), hasIntegerDotProduct));
+
+    return *charKernels;
+}
+
+template<>
+    IntegerKernels<cl_short> &Matrix::integerKernels<cl_short>()
+{
+    if (!shortKernels)
+	shortKernels.reset(new IntegerKernels<cl_short>(context, defaultGemmConfig(device, 32u, 4u, 1u)));
+
+    return *shortKernels;
 }
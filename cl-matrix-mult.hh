@@ -2,7 +2,11 @@
 #define CL_MATRIX_MULT_HH
 
 #include <cstddef>
+#include <stdexcept>
+#include <algorithm>
 #include <functional>
+#include <memory>
+#include <map>
 #include <vector>
 #include <string>
 
@@ -12,38 +16,246 @@
 # include <CL/cl2.hpp>
 #endif
 
-class Matrix
+// Emulated quad precision element, as a double-double pair { high part, low part }
+typedef cl_double2 QuadFloat;
+
+// Type of the scalar arguments (like fill range) for kernels on FloatType elements
+template<typename FloatType>
+    struct MatrixScalar
 {
-    protected:
-	cl::CommandQueue cmdQueue;
-	cl::Program program;
+    typedef FloatType type;
+};
+
+template<>
+    struct MatrixScalar<cl_half>
+{
+    typedef cl_float type;
+};
+
+template<>
+    struct MatrixScalar<QuadFloat>
+{
+    typedef cl_double type;
+};
+
+// Shape of the tiled multiply kernel: result tile for one work group, result lines for one work item,
+// vector width for the columns of one work item and the unroll count for the inner product loop
+struct GemmConfig
+{
+    cl::size_type tileSize;
+    cl::size_type workPerItem;
+    cl_uint vectorWidth;
+    cl_uint unroll;
+
+    cl::size_type colsPerItem() const;
+    cl::size_type workGroupSize() const;
+    cl::size_type tileMultiple(cl::size_type size) const;
+    cl::NDRange globalSize(cl::size_type lines, cl::size_type cols) const;
+    cl::NDRange localSize() const;
+};
+
+// Kernel for batched products: one work item for each product, or one work group for each product
+enum class BatchStrategy
+{
+    Auto, ItemPerMatrix, GroupPerMatrix
+};
+
+// The program and kernels for one element type, built for the given kernel shape
+template<typename FloatType>
+    struct MatrixKernels: GemmConfig
+{
+    typedef typename MatrixScalar<FloatType>::type ScalarType;
+
+    cl::size_type batchTile;	    // work group lines and columns for the batched products, see BATCH_TILE
+    cl::Program program;
 
 #if defined(CL_HPP_PARAM_NAME_INFO_1_0_)
-	cl::KernelFunctor<cl::Buffer, cl_ulong, cl_ulong, cl_float, cl_float> random_fill_float_block;
-	cl::KernelFunctor<cl::Buffer, cl_ulong, cl_ulong, cl::Buffer, cl_ulong, cl_ulong, cl::Buffer, cl_ulong, cl_ulong> multiply_float_matrix_block;
-	// cl::KernelFunctor<cl::Buffer, cl_ulong, cl_ulong, cl_double, cl_double> random_fill_double_block;
+    cl::KernelFunctor<cl::Buffer, cl_ulong, cl_ulong, ScalarType, ScalarType, cl_ulong, cl_ulong> random_fill_block;
+    cl::KernelFunctor<cl::Buffer, cl_ulong, cl_ulong, cl::Buffer, cl_ulong, cl_ulong, cl::Buffer, cl_ulong, cl_ulong> multiply_matrix_block;
+    cl::KernelFunctor<cl::Buffer, cl_uint, cl::Buffer, cl_uint, cl::Buffer, cl_ulong, cl_ulong, cl_ulong, ScalarType, ScalarType> multiply_matrix_tile;
+    cl::KernelFunctor<cl::Buffer, cl_uint, cl::Buffer, cl_uint, cl::Buffer, cl_ulong, cl_ulong, cl_ulong, ScalarType, ScalarType> multiply_half_tile;
+    cl::KernelFunctor<cl::Buffer, cl::Buffer, cl_ulong> convert_to_half;
+    cl::KernelFunctor<cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl_ulong, cl_ulong, cl_ulong> multiply_batch_item;
+    cl::KernelFunctor<cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl_ulong, cl_ulong, cl_ulong> multiply_batch_group;
+    cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl_ulong, ScalarType> matrix_add;
 #else
-	cl::make_kernel<cl::Buffer, cl_ulong, cl_ulong, cl_float, cl_float> random_fill_float_block;
-	cl::make_kernel<cl::Buffer, cl_ulong, cl_ulong, cl::Buffer, cl_ulong, cl_ulong, cl::Buffer, cl_ulong, cl_ulong> multiply_float_matrix_block;
-	// cl::make_kernel<cl::Buffer, cl_ulong, cl_ulong, cl_double, cl_double> random_fill_double_block;
+    cl::make_kernel<cl::Buffer, cl_ulong, cl_ulong, ScalarType, ScalarType, cl_ulong, cl_ulong> random_fill_block;
+    cl::make_kernel<cl::Buffer, cl_ulong, cl_ulong, cl::Buffer, cl_ulong, cl_ulong, cl::Buffer, cl_ulong, cl_ulong> multiply_matrix_block;
+    cl::make_kernel<cl::Buffer, cl_uint, cl::Buffer, cl_uint, cl::Buffer, cl_ulong, cl_ulong, cl_ulong, ScalarType, ScalarType> multiply_matrix_tile;
+    cl::make_kernel<cl::Buffer, cl_uint, cl::Buffer, cl_uint, cl::Buffer, cl_ulong, cl_ulong, cl_ulong, ScalarType, ScalarType> multiply_half_tile;
+    cl::make_kernel<cl::Buffer, cl::Buffer, cl_ulong> convert_to_half;
+    cl::make_kernel<cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl_ulong, cl_ulong, cl_ulong> multiply_batch_item;
+    cl::make_kernel<cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl::Buffer, cl_ulong, cl_ulong, cl_ulong, cl_ulong> multiply_batch_group;
+    cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl_ulong, ScalarType> matrix_add;
 #endif
-	std::vector<cl::Event> waitEvents, mulEvents;
+
+    // buildOptions are added to the compiler options, like -cl-mad-enable
+    MatrixKernels(cl::Context &context, GemmConfig const &config, std::string const &buildOptions = std::string());
+
+    // All the compiler options for the program, as built by the constructor
+    static std::string programOptions(cl::Context const &context, GemmConfig const &config, std::string const &buildOptions = std::string());
+
+    static char const *typeName();
+    static cl::NDRange randomFillSize(cl::size_type lines, cl::size_type cols);
+};
+
+// The program and kernels for integer matrices of cl_char or cl_short elements, with int results
+template<typename IntegerType>
+    struct IntegerKernels: GemmConfig
+{
+    cl::Program program;
+
+#if defined(CL_HPP_PARAM_NAME_INFO_1_0_)
+    cl::KernelFunctor<cl::Buffer, cl_ulong, cl_ulong, cl_int, cl_int, cl_ulong, cl_ulong> random_fill_block;
+    cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl_ulong, cl_ulong, cl_ulong> multiply_tile;
+#else
+    cl::make_kernel<cl::Buffer, cl_ulong, cl_ulong, cl_int, cl_int, cl_ulong, cl_ulong> random_fill_block;
+    cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl_ulong, cl_ulong, cl_ulong> multiply_tile;
+#endif
+
+    // With dotProduct, the program is built for OpenCL C 3.0, for the cl_khr_integer_dot_product built-ins
+    IntegerKernels(cl::Context &context, GemmConfig const &config, bool dotProduct = false);
+
+    static char const *typeName();
+};
+
+template<typename FloatType>
+    class MatrixView;
+
+// Matrix operations run on an out-of-order queue (if the device has one), with dependencies only between
+// commands that use the same buffer: a command waits for the last write to each of its buffers, and a
+// write also waits for the reads of the buffer since then. Independent fills and multiplications
+// can then run concurrently.
+class Matrix
+{
+    protected:
+	struct BufferEvents
+	{
+	    cl::Event write;
+	    std::vector<cl::Event> reads;
+	};
+
+	cl::Context context;
+	cl::Device device;
+	cl_uint vectorWidthOverride;
+	bool hasFp64, hasFp16, hostUnifiedMemory;
+	cl::CommandQueue cmdQueue;
+
+	MatrixKernels<cl_float> floatKernels;
+	std::unique_ptr<MatrixKernels<cl_double>> doubleKernels;
+	std::unique_ptr<MatrixKernels<cl_half>> halfKernels;
+	std::unique_ptr<MatrixKernels<QuadFloat>> quadKernels;
+	std::unique_ptr<IntegerKernels<cl_char>> charKernels;
+	std::unique_ptr<IntegerKernels<cl_short>> shortKernels;
+	bool hasIntegerDotProduct;
+
+	std::map<cl_mem, BufferEvents> bufferEvents;
+
+	template<typename FloatType>
+	    MatrixKernels<FloatType> &kernels();
+
+	template<typename IntegerType>
+	    IntegerKernels<IntegerType> &integerKernels();
+
+	void readDependencies(cl::Buffer const &buffer, std::vector<cl::Event> &dependencies);
+	void writeDependencies(cl::Buffer const &buffer, std::vector<cl::Event> &dependencies);
+	void readEvent(cl::Buffer const &buffer, cl::Event const &event);
+	void writeEvent(cl::Buffer const &buffer, cl::Event const &event);
+
+	template<typename FloatType>
+	    cl::Event enqueueBatch
+		(
+		    cl::Buffer const &m, cl::size_type m_stride, cl::Buffer const &n, cl::size_type n_stride, cl::Buffer &result, cl::size_type result_stride,
+		    cl::Buffer const &offsets, cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type batchCount, BatchStrategy strategy
+		);
 
 	Matrix(Matrix const &other) = delete;
 	Matrix &operator =(Matrix const &other) = delete;
 
+	template<typename FloatType>
+	    friend class MatrixView;
+
     public:
-	Matrix(cl::Context &context);
+	Matrix(cl::Context &context, cl_uint vectorWidth = 0u, cl_command_queue_properties queueProperties = 0u);
 	~Matrix() = default;
 
 	template<typename FloatType>
-	    void random_fill(cl::Buffer &outputBuffer, cl::size_type M, cl::size_type N, FloatType min_value, FloatType max_value);
+	    bool supports() const;
+
+	// Device memory is shared with the host (CL_DEVICE_HOST_UNIFIED_MEMORY), so mapped buffers need no copy
+	bool hasHostUnifiedMemory() const;
+
+	// New buffer for a lines x cols matrix, allocated by the runtime in host-accessible (pinned) memory
+	// with CL_MEM_ALLOC_HOST_PTR on unified memory devices, so it can be mapped with no copy
+	template<typename FloatType>
+	    cl::Buffer createBuffer(cl::size_type lines, cl::size_type cols, cl_mem_flags flags);
+
+	template<typename FloatType>
+	    void random_fill(cl::Buffer &outputBuffer, cl::size_type M, cl::size_type N, typename MatrixScalar<FloatType>::type min_value, typename MatrixScalar<FloatType>::type max_value, cl_ulong seed = 0u, cl_ulong stream = 0u);
 
 	template<typename FloatType>
 	    void zero_fill(cl::Buffer &outputBuffer, cl::size_type M, cl::size_type N);
 
+	// result = alpha * op(m) * op(n) + beta * result, where op(m) is lines x inner and op(n) is inner x cols,
+	// and the stored matrix is transposed if transposeM / transposeN is set. The result is not read if beta
+	// is 0, so it needs no zero_fill() before.
+	template<typename FloatType>
+	    cl::Event gemm
+		(
+		    bool transposeM, bool transposeN, cl::size_type lines, cl::size_type inner, cl::size_type cols,
+		    typename MatrixScalar<FloatType>::type alpha, cl::Buffer const &m, cl::Buffer const &n,
+		    typename MatrixScalar<FloatType>::type beta, cl::Buffer &result
+		);
+
+	// Same as gemm(), for matrices stored as half (cl_half), with float products and sums. Elements are
+	// converted with vload_half() and vstore_half(), so this needs no cl_khr_fp16 support on the device.
+	cl::Event gemm_half
+	    (
+		bool transposeM, bool transposeN, cl::size_type lines, cl::size_type inner, cl::size_type cols,
+		cl_float alpha, cl::Buffer const &m, cl::Buffer const &n, cl_float beta, cl::Buffer &result
+	    );
+
+	// Store count elements of the matrix as half (cl_half), in halfBuffer
 	template<typename FloatType>
-	    void multiply(cl::Buffer const &m, cl::size_type m_lines, cl::size_type m_cols, cl::Buffer const &n, cl::size_type n_lines, cl::size_type n_cols, cl::Buffer &result, cl::size_type lines, cl::size_type cols);
+	    void convert_to_half(cl::Buffer const &matrix, cl::Buffer &halfBuffer, cl::size_type count);
+
+	// Uniform cl_char or cl_short elements in [min_value, max_value]
+	template<typename IntegerType>
+	    void random_fill_integer(cl::Buffer &outputBuffer, cl::size_type M, cl::size_type N, cl_int min_value, cl_int max_value, cl_ulong seed = 0u, cl_ulong stream = 0u);
+
+	// result = m * n, for cl_char or cl_short matrices and a cl_int result, with int sums that wrap
+	// around on overflow. The char products use the dot product from cl_khr_integer_dot_product
+	// if the device has it, see hasDotProduct().
+	template<typename IntegerType>
+	    cl::Event multiply_integer(cl::Buffer const &m, cl::Buffer const &n, cl::Buffer &result, cl::size_type lines, cl::size_type inner, cl::size_type cols);
+
+	// The device has cl_khr_integer_dot_product, and OpenCL C 3.0 to build the char kernels with it
+	bool hasDotProduct() const;
+
+	// result += m * n
+	template<typename FloatType>
+	    cl::Event multiply(cl::Buffer const &m, cl::size_type m_lines, cl::size_type m_cols, cl::Buffer const &n, cl::size_type n_lines, cl::size_type n_cols, cl::Buffer &result, cl::size_type lines, cl::size_type cols);
+
+	// batchCount products of lines x inner by inner x cols matrices in one kernel launch, with matrix b at
+	// element b * stride of each buffer (a stride of 0 means packed matrices). The result is overwritten.
+	template<typename FloatType>
+	    cl::Event multiplyBatched
+		(
+		    cl::Buffer const &m, cl::size_type m_stride, cl::Buffer const &n, cl::size_type n_stride, cl::Buffer &result, cl::size_type result_stride,
+		    cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type batchCount, BatchStrategy strategy = BatchStrategy::Auto
+		);
+
+	// Same, with the element offsets of matrix b in m, n and result given by offsets[3 * b], offsets[3 * b + 1]
+	// and offsets[3 * b + 2], as cl_ulong values
+	template<typename FloatType>
+	    cl::Event multiplyBatched
+		(
+		    cl::Buffer const &m, cl::Buffer const &n, cl::Buffer &result, cl::Buffer const &offsets,
+		    cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type batchCount, BatchStrategy strategy = BatchStrategy::Auto
+		);
+
+	template<typename FloatType>
+	    cl::Event multiply_naive(cl::Buffer const &m, cl::size_type m_lines, cl::size_type m_cols, cl::Buffer const &n, cl::size_type n_lines, cl::size_type n_cols, cl::Buffer &result, cl::size_type lines, cl::size_type cols);
 
 	template<typename FloatType>
 	    void readBufferRectAsync(cl::Buffer const &inputBuff, cl::size_type buffLines, cl::size_type buffCols, cl::size_type startLn, cl::size_type startCol, cl::size_type lines, cl::size_type cols, std::vector<FloatType> &region);
@@ -51,22 +263,216 @@ class Matrix
 	template<typename FloatType>
 	    void readBufferRect(cl::Buffer const &inputBuff, cl::size_type buffLines, cl::size_type buffCols, cl::size_type startLn, cl::size_type startCol, cl::size_type lines, cl::size_type cols, std::vector<FloatType> &region);
 
+	// Map a region of the buffer for reading on the host, after the pending writes to the buffer. On unified
+	// memory devices the view points into the buffer memory, with no copy.
+	template<typename FloatType>
+	    MatrixView<FloatType> mapBufferRect(cl::Buffer const &inputBuff, cl::size_type buffLines, cl::size_type buffCols, cl::size_type startLn, cl::size_type startCol, cl::size_type lines, cl::size_type cols);
+
+	// Wait for all pending commands, or only for the pending commands using the given buffer
 	void waitForCompletion();
+	void waitForCompletion(cl::Buffer const &buffer);
+
+	template<typename FloatType>
+	    cl_uint vectorWidth();
+
+	template<typename FloatType>
+	    GemmConfig const &gemmConfig();
+
+	static BatchStrategy batchStrategy(cl::size_type lines, cl::size_type inner, cl::size_type cols, BatchStrategy strategy);
+
+	static GemmConfig defaultGemmConfig(cl::Device const &device, cl::size_type tileSize, cl::size_type workPerItem, cl_uint vectorWidth);
+
+	// Build the float and double kernel programs for the devices concurrently, ahead of the Matrix objects
+	static void buildAll(std::vector<std::reference_wrapper<cl::Device>> const &devices, cl_uint vectorWidth = 0u);
+};
+
+// Read-only host view of a mapped buffer region, with the line stride of the buffer. The region is unmapped
+// when the view is destroyed, and later writes to the buffer wait for the unmap.
+template<typename FloatType>
+    class MatrixView
+{
+    protected:
+	Matrix *matrix;
+	cl::Buffer buffer;
+	void *mappedPointer;
+	FloatType const *viewData;
+	cl::size_type viewStride, viewLines, viewCols;
+
+	MatrixView(MatrixView const &other) = delete;
+	MatrixView &operator =(MatrixView const &other) = delete;
+
+    public:
+	MatrixView(Matrix &matrix, cl::Buffer const &buffer, void *mappedPointer, FloatType const *data, cl::size_type stride, cl::size_type lines, cl::size_type cols);
+	MatrixView(MatrixView &&other);
+	~MatrixView();
+
+	FloatType const &operator ()(cl::size_type line, cl::size_type col) const;
+	FloatType const *data() const;
+	cl::size_type stride() const;
+	cl::size_type lines() const;
+	cl::size_type cols() const;
 };
 
 std::string readSourceFile(char const *file_name);
+char const *matrixProgramFile();
+std::string matrixProgramSource();
+
+// Columns of the result computed by one work item, see COLS_PER_ITEM in the kernel source
+inline cl::size_type GemmConfig::colsPerItem() const
+{
+    return std::max<cl::size_type>(workPerItem, vectorWidth);
+}
+
+inline cl::size_type GemmConfig::workGroupSize() const
+{
+    return (tileSize / colsPerItem()) * (tileSize / workPerItem);
+}
+
+inline cl::size_type GemmConfig::tileMultiple(cl::size_type size) const
+{
+    return (size + tileSize - 1) / tileSize * tileSize;
+}
+
+// Each work item computes a workPerItem x colsPerItem() block of the result, columns first
+inline cl::NDRange GemmConfig::globalSize(cl::size_type lines, cl::size_type cols) const
+{
+    return cl::NDRange(tileMultiple(cols) / colsPerItem(), tileMultiple(lines) / workPerItem);
+}
+
+inline cl::NDRange GemmConfig::localSize() const
+{
+    return cl::NDRange(tileSize / colsPerItem(), tileSize / workPerItem);
+}
+
+// One work item for each Philox block of 4 float (or 2 double) random elements, see RANDOM_PER_BLOCK
+template<typename FloatType>
+    inline cl::NDRange MatrixKernels<FloatType>::randomFillSize(cl::size_type lines, cl::size_type cols)
+{
+    cl::size_type const randomPerBlock = sizeof(ScalarType) == sizeof(cl_double) ? 2u : 4u;
+
+    return cl::NDRange((lines * cols + randomPerBlock - 1u) / randomPerBlock);
+}
+
+template<>
+    MatrixKernels<cl_double> &Matrix::kernels<cl_double>();
 
 template<>
-    inline void Matrix::random_fill<cl_float>(cl::Buffer &outputBuffer, cl::size_type M, cl::size_type N, cl_float min_value, cl_float max_value)
+    MatrixKernels<cl_half> &Matrix::kernels<cl_half>();
+
+template<>
+    MatrixKernels<QuadFloat> &Matrix::kernels<QuadFloat>();
+
+template<>
+    inline MatrixKernels<cl_float> &Matrix::kernels<cl_float>()
 {
-    waitEvents.push_back(random_fill_float_block(cl::EnqueueArgs(cmdQueue, cl::NDRange(M, N), cl::NDRange(16, 16)), outputBuffer, M, N, min_value, max_value));
-};
+    return floatKernels;
+}
+
+template<>
+    inline bool Matrix::supports<cl_float>() const
+{
+    return true;
+}
+
+template<>
+    inline bool Matrix::supports<cl_double>() const
+{
+    return hasFp64;
+}
+
+template<>
+    inline bool Matrix::supports<cl_half>() const
+{
+    return hasFp16;
+}
+
+template<>
+    inline bool Matrix::supports<QuadFloat>() const
+{
+    return hasFp64;
+}
+
+inline bool Matrix::hasHostUnifiedMemory() const
+{
+    return hostUnifiedMemory;
+}
+
+inline bool Matrix::hasDotProduct() const
+{
+    return hasIntegerDotProduct;
+}
+
+template<>
+    IntegerKernels<cl_char> &Matrix::integerKernels<cl_char>();
 
 template<>
-    inline void Matrix::zero_fill<cl_float>(cl::Buffer &outputBuffer, cl::size_type M, cl::size_type N)
+    IntegerKernels<cl_short> &Matrix::integerKernels<cl_short>();
+
+// One work item for each Philox block of 4 elements
+template<typename IntegerType>
+    inline void Matrix::random_fill_integer(cl::Buffer &outputBuffer, cl::size_type M, cl::size_type N, cl_int min_value, cl_int max_value, cl_ulong seed, cl_ulong stream)
+{
+    std::vector<cl::Event> dependencies;
+
+    writeDependencies(outputBuffer, dependencies);
+    writeEvent(outputBuffer, integerKernels<IntegerType>().random_fill_block(cl::EnqueueArgs(cmdQueue, dependencies, cl::NDRange((M * N + 3u) / 4u)), outputBuffer, M, N, min_value, max_value, seed, stream));
+}
+
+template<typename IntegerType>
+    inline cl::Event Matrix::multiply_integer(cl::Buffer const &m, cl::Buffer const &n, cl::Buffer &result, cl::size_type lines, cl::size_type inner, cl::size_type cols)
+{
+    IntegerKernels<IntegerType> &kernels = integerKernels<IntegerType>();
+    std::vector<cl::Event> dependencies;
+
+    readDependencies(m, dependencies);
+    readDependencies(n, dependencies);
+    writeDependencies(result, dependencies);
+
+    cl::Event event = kernels.multiply_tile(cl::EnqueueArgs(cmdQueue, dependencies, kernels.globalSize(lines, cols), kernels.localSize()), m, n, result, lines, inner, cols);
+
+    readEvent(m, event);
+    readEvent(n, event);
+    writeEvent(result, event);
+
+    return event;
+}
+
+template<typename FloatType>
+    inline cl::Buffer Matrix::createBuffer(cl::size_type lines, cl::size_type cols, cl_mem_flags flags)
+{
+    return cl::Buffer(context, flags | (hostUnifiedMemory ? CL_MEM_ALLOC_HOST_PTR : 0u), lines * cols * sizeof(FloatType));
+}
+
+template<typename FloatType>
+    inline cl_uint Matrix::vectorWidth()
+{
+    return kernels<FloatType>().vectorWidth;
+}
+
+template<typename FloatType>
+    inline GemmConfig const &Matrix::gemmConfig()
 {
-    waitEvents.emplace_back();
-    cmdQueue.enqueueFillBuffer<cl_float>(outputBuffer, cl_float(0.0f), 0, M * N * sizeof(cl_float), nullptr, &(*waitEvents.rbegin()));
+    return kernels<FloatType>();
+}
+
+template<typename FloatType>
+    inline void Matrix::random_fill(cl::Buffer &outputBuffer, cl::size_type M, cl::size_type N, typename MatrixScalar<FloatType>::type min_value, typename MatrixScalar<FloatType>::type max_value, cl_ulong seed, cl_ulong stream)
+{
+    std::vector<cl::Event> dependencies;
+
+    writeDependencies(outputBuffer, dependencies);
+    writeEvent(outputBuffer, kernels<FloatType>().random_fill_block(cl::EnqueueArgs(cmdQueue, dependencies, MatrixKernels<FloatType>::randomFillSize(M, N)), outputBuffer, M, N, min_value, max_value, seed, stream));
+};
+
+template<typename FloatType>
+    inline void Matrix::zero_fill(cl::Buffer &outputBuffer, cl::size_type M, cl::size_type N)
+{
+    std::vector<cl::Event> dependencies;
+    cl::Event event;
+
+    writeDependencies(outputBuffer, dependencies);
+    cmdQueue.enqueueFillBuffer<FloatType>(outputBuffer, FloatType(), 0, M * N * sizeof(FloatType), &dependencies, &event);
+    writeEvent(outputBuffer, event);
 }
 
 template<typename FloatType>
@@ -77,11 +483,14 @@ template<typename FloatType>
 
     region.resize(cols * lines);
 
+    std::vector<cl::Event> dependencies;
     cl::Event event;
+
+    readDependencies(inputBuff, dependencies);
     cmdQueue.enqueueReadBufferRect(inputBuff, CL_FALSE, { startCol * sizeof (FloatType), startLn, 0 }, { 0, 0, 0 }, { cols * sizeof(FloatType), lines, 1 },
 	    buffCols * sizeof(FloatType), buffCols * buffLines * sizeof(FloatType), cols * sizeof(FloatType), cols * lines * sizeof(FloatType),
-	    region.data(), (mulEvents.empty() ? &waitEvents : &mulEvents), &event);
-    mulEvents.push_back(event);
+	    region.data(), &dependencies, &event);
+    readEvent(inputBuff, event);
 }
 
 template<typename FloatType>
@@ -92,28 +501,326 @@ template<typename FloatType>
 
     region.resize(cols * lines);
 
+    std::vector<cl::Event> dependencies;
+
+    readDependencies(inputBuff, dependencies);
     cmdQueue.enqueueReadBufferRect(inputBuff, CL_TRUE, { startCol * sizeof (FloatType), startLn, 0 }, { 0, 0, 0 }, { cols * sizeof(FloatType), lines, 1 },
 	    buffCols * sizeof(FloatType), buffCols * buffLines * sizeof(FloatType), cols * sizeof(FloatType), cols * lines * sizeof(FloatType),
-	    region.data(), (mulEvents.empty() ? &waitEvents : &mulEvents));
+	    region.data(), &dependencies);
+}
+
+// Map only the bytes from the first to the last element of the region, as one range of whole lines. An empty
+// region, or one that starts outside the buffer, gives an empty view, with nothing mapped.
+template<typename FloatType>
+    MatrixView<FloatType> Matrix::mapBufferRect(cl::Buffer const &inputBuff, cl::size_type buffLines, cl::size_type buffCols, cl::size_type startLn, cl::size_type startCol, cl::size_type lines, cl::size_type cols)
+{
+    if (!lines || !cols || startLn >= buffLines || startCol >= buffCols)
+	return MatrixView<FloatType>(*this, inputBuff, nullptr, nullptr, buffCols, 0u, 0u);
+
+    cols = std::min(cols, buffCols - startCol);
+    lines = std::min(lines, buffLines - startLn);
+
+    std::vector<cl::Event> dependencies;
+    cl::size_type const offset = (startLn * buffCols + startCol) * sizeof(FloatType), size = ((lines - 1u) * buffCols + cols) * sizeof(FloatType);
+
+    readDependencies(inputBuff, dependencies);
+
+    void *mappedPointer = cmdQueue.enqueueMapBuffer(inputBuff, CL_TRUE, CL_MAP_READ, offset, size, &dependencies);
+
+    return MatrixView<FloatType>(*this, inputBuff, mappedPointer, static_cast<FloatType const *>(mappedPointer), buffCols, lines, cols);
+}
+
+template<typename FloatType>
+    inline MatrixView<FloatType>::MatrixView(Matrix &matrix, cl::Buffer const &buffer, void *mappedPointer, FloatType const *data, cl::size_type stride, cl::size_type lines, cl::size_type cols)
+	: matrix(&matrix), buffer(buffer), mappedPointer(mappedPointer), viewData(data), viewStride(stride), viewLines(lines), viewCols(cols)
+{
+}
+
+template<typename FloatType>
+    inline MatrixView<FloatType>::MatrixView(MatrixView &&other)
+	: matrix(other.matrix), buffer(other.buffer), mappedPointer(other.mappedPointer), viewData(other.viewData), viewStride(other.viewStride), viewLines(other.viewLines), viewCols(other.viewCols)
+{
+    other.mappedPointer = nullptr;
+}
+
+template<typename FloatType>
+    MatrixView<FloatType>::~MatrixView()
+{
+    if (mappedPointer)
+	try
+	{
+	    cl::Event event;
+
+	    matrix->cmdQueue.enqueueUnmapMemObject(buffer, mappedPointer, nullptr, &event);
+	    matrix->readEvent(buffer, event);
+	}
+	catch (cl::Error const &)
+	{
+	    // No exceptions from the destructor, the mapping is released with the buffer anyway
+	}
+}
+
+template<typename FloatType>
+    inline FloatType const &MatrixView<FloatType>::operator ()(cl::size_type line, cl::size_type col) const
+{
+    return viewData[line * viewStride + col];
+}
+
+template<typename FloatType>
+    inline FloatType const *MatrixView<FloatType>::data() const
+{
+    return viewData;
+}
+
+template<typename FloatType>
+    inline cl::size_type MatrixView<FloatType>::stride() const
+{
+    return viewStride;
+}
+
+template<typename FloatType>
+    inline cl::size_type MatrixView<FloatType>::lines() const
+{
+    return viewLines;
+}
+
+template<typename FloatType>
+    inline cl::size_type MatrixView<FloatType>::cols() const
+{
+    return viewCols;
+}
+
+inline void Matrix::readDependencies(cl::Buffer const &buffer, std::vector<cl::Event> &dependencies)
+{
+    auto it = bufferEvents.find(buffer());
+
+    if (it != bufferEvents.end() && it->second.write())
+	dependencies.push_back(it->second.write);
+}
+
+inline void Matrix::writeDependencies(cl::Buffer const &buffer, std::vector<cl::Event> &dependencies)
+{
+    auto it = bufferEvents.find(buffer());
+
+    if (it != bufferEvents.end())
+    {
+	if (it->second.write())
+	    dependencies.push_back(it->second.write);
+
+	dependencies.insert(dependencies.end(), it->second.reads.begin(), it->second.reads.end());
+    }
+}
+
+inline void Matrix::readEvent(cl::Buffer const &buffer, cl::Event const &event)
+{
+    bufferEvents[buffer()].reads.push_back(event);
+}
+
+inline void Matrix::writeEvent(cl::Buffer const &buffer, cl::Event const &event)
+{
+    BufferEvents &events = bufferEvents[buffer()];
+
+    events.write = event;
+    events.reads.clear();
+}
+
+inline void Matrix::waitForCompletion(cl::Buffer const &buffer)
+{
+    std::vector<cl::Event> dependencies;
+
+    writeDependencies(buffer, dependencies);
+
+    if (!dependencies.empty())
+	cl::Event::waitForEvents(dependencies);
+
+    bufferEvents.erase(buffer());
 }
 
 inline void Matrix::waitForCompletion()
 {
-    if (mulEvents.empty())
+    std::vector<cl::Event> dependencies;
+
+    for (auto const &events: bufferEvents)
     {
-	cl::Event::waitForEvents(waitEvents);
-	waitEvents.clear();
+	if (events.second.write())
+	    dependencies.push_back(events.second.write);
+
+	dependencies.insert(dependencies.end(), events.second.reads.begin(), events.second.reads.end());
     }
+
+    if (!dependencies.empty())
+	cl::Event::waitForEvents(dependencies);
+
+    bufferEvents.clear();
+}
+
+template<typename FloatType>
+    inline cl::Event Matrix::gemm
+	(
+	    bool transposeM, bool transposeN, cl::size_type lines, cl::size_type inner, cl::size_type cols,
+	    typename MatrixScalar<FloatType>::type alpha, cl::Buffer const &m, cl::Buffer const &n,
+	    typename MatrixScalar<FloatType>::type beta, cl::Buffer &result
+	)
+{
+    MatrixKernels<FloatType> &kernels = this->kernels<FloatType>();
+    std::vector<cl::Event> dependencies;
+
+    readDependencies(m, dependencies);
+    readDependencies(n, dependencies);
+    writeDependencies(result, dependencies);
+
+    cl::Event event = kernels.multiply_matrix_tile
+	(
+	    cl::EnqueueArgs(cmdQueue, dependencies, kernels.globalSize(lines, cols), kernels.localSize()),
+	    m, transposeM, n, transposeN, result, lines, inner, cols, alpha, beta
+	);
+
+    readEvent(m, event);
+    readEvent(n, event);
+    writeEvent(result, event);
+
+    return event;
+}
+
+inline cl::Event Matrix::gemm_half
+    (
+	bool transposeM, bool transposeN, cl::size_type lines, cl::size_type inner, cl::size_type cols,
+	cl_float alpha, cl::Buffer const &m, cl::Buffer const &n, cl_float beta, cl::Buffer &result
+    )
+{
+    MatrixKernels<cl_float> &kernels = this->kernels<cl_float>();
+    std::vector<cl::Event> dependencies;
+
+    readDependencies(m, dependencies);
+    readDependencies(n, dependencies);
+    writeDependencies(result, dependencies);
+
+    cl::Event event = kernels.multiply_half_tile
+	(
+	    cl::EnqueueArgs(cmdQueue, dependencies, kernels.globalSize(lines, cols), kernels.localSize()),
+	    m, transposeM, n, transposeN, result, lines, inner, cols, alpha, beta
+	);
+
+    readEvent(m, event);
+    readEvent(n, event);
+    writeEvent(result, event);
+
+    return event;
+}
+
+template<typename FloatType>
+    inline void Matrix::convert_to_half(cl::Buffer const &matrix, cl::Buffer &halfBuffer, cl::size_type count)
+{
+    std::vector<cl::Event> dependencies;
+
+    readDependencies(matrix, dependencies);
+    writeDependencies(halfBuffer, dependencies);
+
+    cl::Event event = kernels<FloatType>().convert_to_half(cl::EnqueueArgs(cmdQueue, dependencies, cl::NDRange(count)), matrix, halfBuffer, count);
+
+    readEvent(matrix, event);
+    writeEvent(halfBuffer, event);
+}
+
+template<typename FloatType>
+    inline cl::Event Matrix::multiply(cl::Buffer const &m, cl::size_type m_lines, cl::size_type m_cols, cl::Buffer const &n, cl::size_type n_lines, cl::size_type n_cols, cl::Buffer &result, cl::size_type lines, cl::size_type cols)
+{
+    if (m_lines != lines || m_cols != n_lines || n_cols != cols)
+	throw std::invalid_argument("Matrix sizes do not match for multiplication");
+
+    return gemm<FloatType>(false, false, lines, m_cols, cols, 1, m, n, 1, result);
+}
+
+// Products with results up to 8 x 8 are left to single work items, larger ones get a work group each
+inline BatchStrategy Matrix::batchStrategy(cl::size_type lines, cl::size_type inner, cl::size_type cols, BatchStrategy strategy)
+{
+    if (strategy == BatchStrategy::Auto)
+	return lines <= 8u && cols <= 8u && inner <= 64u ? BatchStrategy::ItemPerMatrix : BatchStrategy::GroupPerMatrix;
+
+    return strategy;
+}
+
+template<typename FloatType>
+    cl::Event Matrix::enqueueBatch
+	(
+	    cl::Buffer const &m, cl::size_type m_stride, cl::Buffer const &n, cl::size_type n_stride, cl::Buffer &result, cl::size_type result_stride,
+	    cl::Buffer const &offsets, cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type batchCount, BatchStrategy strategy
+	)
+{
+    MatrixKernels<FloatType> &kernels = this->kernels<FloatType>();
+    std::vector<cl::Event> dependencies;
+    cl::Event event;
+
+    readDependencies(m, dependencies);
+    readDependencies(n, dependencies);
+    writeDependencies(result, dependencies);
+
+    if (offsets())
+	readDependencies(offsets, dependencies);
+
+    if (batchStrategy(lines, inner, cols, strategy) == BatchStrategy::ItemPerMatrix)
+	event = kernels.multiply_batch_item
+	    (
+		cl::EnqueueArgs(cmdQueue, dependencies, cl::NDRange(batchCount)),
+		m, m_stride, n, n_stride, result, result_stride, offsets, lines, inner, cols, batchCount
+	    );
     else
-    {	cl::Event::waitForEvents(mulEvents);
-	mulEvents.clear();
-    }
+	event = kernels.multiply_batch_group
+	    (
+		cl::EnqueueArgs(cmdQueue, dependencies, cl::NDRange(batchCount * kernels.batchTile, kernels.batchTile), cl::NDRange(kernels.batchTile, kernels.batchTile)),
+		m, m_stride, n, n_stride, result, result_stride, offsets, lines, inner, cols, batchCount
+	    );
+
+    readEvent(m, event);
+    readEvent(n, event);
+    writeEvent(result, event);
+
+    if (offsets())
+	readEvent(offsets, event);
+
+    return event;
 }
 
-template<>
-    inline void Matrix::multiply<cl_float>(cl::Buffer const &m, cl::size_type m_lines, cl::size_type m_cols, cl::Buffer const &n, cl::size_type n_lines, cl::size_type n_cols, cl::Buffer &result, cl::size_type lines, cl::size_type cols)
+template<typename FloatType>
+    inline cl::Event Matrix::multiplyBatched
+	(
+	    cl::Buffer const &m, cl::size_type m_stride, cl::Buffer const &n, cl::size_type n_stride, cl::Buffer &result, cl::size_type result_stride,
+	    cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type batchCount, BatchStrategy strategy
+	)
 {
-    mulEvents.push_back(multiply_float_matrix_block(cl::EnqueueArgs(cmdQueue, waitEvents, cl::NDRange(lines, cols), cl::NDRange(16, 16)),  m, m_lines, m_cols, n, n_lines, n_cols, result, lines, cols));
+    return enqueueBatch<FloatType>
+	(
+	    m, m_stride ? m_stride : lines * inner, n, n_stride ? n_stride : inner * cols, result, result_stride ? result_stride : lines * cols,
+	    cl::Buffer(), lines, inner, cols, batchCount, strategy
+	);
+}
+
+template<typename FloatType>
+    inline cl::Event Matrix::multiplyBatched
+	(
+	    cl::Buffer const &m, cl::Buffer const &n, cl::Buffer &result, cl::Buffer const &offsets,
+	    cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type batchCount, BatchStrategy strategy
+	)
+{
+    return enqueueBatch<FloatType>(m, 0u, n, 0u, result, 0u, offsets, lines, inner, cols, batchCount, strategy);
+}
+
+template<typename FloatType>
+    inline cl::Event Matrix::multiply_naive(cl::Buffer const &m, cl::size_type m_lines, cl::size_type m_cols, cl::Buffer const &n, cl::size_type n_lines, cl::size_type n_cols, cl::Buffer &result, cl::size_type lines, cl::size_type cols)
+{
+    std::vector<cl::Event> dependencies;
+
+    readDependencies(m, dependencies);
+    readDependencies(n, dependencies);
+    writeDependencies(result, dependencies);
+
+    cl::Event event = kernels<FloatType>().multiply_matrix_block(cl::EnqueueArgs(cmdQueue, dependencies, cl::NDRange(lines, cols)),  m, m_lines, m_cols, n, n_lines, n_cols, result, lines, cols);
+
+    readEvent(m, event);
+    readEvent(n, event);
+    writeEvent(result, event);
+
+    return event;
 }
 
 #endif // CL_MATRIX_MULT_HH
@@ -0,0 +1,148 @@
+#include <cstddef>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "cl-matrix-stream.hh"
+#include "cl-matrix-multi.hh"
+
+using std::size_t;
+using std::max;
+using std::vector;
+using std::thread;
+using std::exception_ptr;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+using cl::Device;
+using cl::Context;
+
+MultiDeviceMatrix::MultiDeviceMatrix(vector<Device> const &devices, cl_uint vectorWidth)
+    : devices(devices), speeds(devices.size(), 1.0)
+{
+    for (auto const &device: devices)
+    {
+	contexts.emplace_back(device);
+	streams.emplace_back(new MatrixStream(contexts.back(), vectorWidth));
+    }
+}
+
+// Blocks on one line of the result for calibrate() to time, so the speed includes the transfers that
+// overlap with the multiplies, and the m panels kept for the next blocks, as in multiply()
+static cl::size_type const CALIBRATION_BLOCK_COUNT = 4u;
+
+template<typename FloatType>
+    void MultiDeviceMatrix::calibrate(cl::size_type blockSize)
+{
+    cl::size_type const cols = CALIBRATION_BLOCK_COUNT * blockSize;
+    vector<FloatType> m(blockSize * blockSize), n(blockSize * cols), result(blockSize * cols);
+    vector<MatrixRegion> regions;
+
+    for (cl::size_type jb = 0u; jb < cols; jb += blockSize)
+	regions.push_back({ 0u, jb, blockSize, blockSize });
+
+    for (size_t i = 0u; i < streams.size(); i++)
+    {
+	double bestSpeed = 0.0;
+
+	// The first run includes building the kernels
+	for (unsigned pass = 0u; pass < 2u; pass++)
+	{
+	    auto const startTime = steady_clock::now();
+
+	    streams[i]->multiply_regions(m.data(), blockSize, n.data(), cols, result.data(), cols, blockSize, regions, blockSize);
+	    bestSpeed = max(bestSpeed, 2.0 * blockSize * blockSize * cols / duration<double, std::nano>(steady_clock::now() - startTime).count());
+	}
+
+	speeds[i] = bestSpeed;
+    }
+}
+
+vector<unsigned> MultiDeviceMatrix::distribution(size_t blockCount) const
+{
+    return weighted_round_robin(speeds, blockCount);
+}
+
+template<typename FloatType>
+    void MultiDeviceMatrix::multiply(FloatType const *m, FloatType const *n, FloatType *result, cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type blockSize)
+{
+    cl::size_type const blockLines = (lines + blockSize - 1u) / blockSize, blockCols = (cols + blockSize - 1u) / blockSize;
+    vector<unsigned> const owners = distribution(blockLines * blockCols);
+    vector<exception_ptr> errors(streams.size());
+    vector<thread> threads;
+
+    for (unsigned deviceIndex = 0u; deviceIndex < streams.size(); deviceIndex++)
+	threads.emplace_back
+	    (
+		[&, deviceIndex]()
+		{
+		    try
+		    {
+			vector<MatrixRegion> const regions = owned_blocks(owners, deviceIndex, lines, cols, blockSize);
+
+			streams[deviceIndex]->multiply_regions(m, inner, n, cols, result, cols, inner, regions, blockSize);
+		    }
+		    catch (...)
+		    {
+			errors[deviceIndex] = std::current_exception();
+		    }
+		}
+	    );
+
+    for (auto &deviceThread: threads)
+	deviceThread.join();
+
+    for (auto const &error: errors)
+	if (error)
+	    std::rethrow_exception(error);
+}
+
+extern vector<Device> partition_cpu_devices(vector<Device> const &devices, unsigned subDeviceCount)
+{
+    vector<Device> result;
+
+    for (auto const &device: devices)
+    {
+	cl_uint const computeUnits = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+
+	if
+	    (
+		subDeviceCount > 1u
+		    &&
+		(device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU)
+		    &&
+		device.getInfo<CL_DEVICE_PARTITION_MAX_SUB_DEVICES>() >= subDeviceCount
+		    &&
+		computeUnits >= subDeviceCount
+	    )
+	{
+	    cl_device_partition_property const properties[] =
+		{ CL_DEVICE_PARTITION_EQUALLY, static_cast<cl_device_partition_property>(computeUnits / subDeviceCount), 0 };
+
+	    Device parentDevice(device);
+	    cl::vector<Device> subDevices;
+
+	    parentDevice.createSubDevices(properties, &subDevices);
+	    result.insert(result.end(), subDevices.begin(), subDevices.end());
+	}
+	else
+	    result.push_back(device);
+    }
+
+    return result;
+}
+
+template void MultiDeviceMatrix::calibrate<cl_float>(cl::size_type blockSize);
+template void MultiDeviceMatrix::calibrate<cl_double>(cl::size_type blockSize);
+
+template void MultiDeviceMatrix::multiply<cl_float>(cl_float const *m, cl_float const *n, cl_float *result, cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type blockSize);
+template void MultiDeviceMatrix::multiply<cl_double>(cl_double const *m, cl_double const *n, cl_double *result, cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type blockSize);
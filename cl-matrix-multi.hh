@@ -0,0 +1,110 @@
+#if !defined(CL_MATRIX_MULTI_HH)
+#define CL_MATRIX_MULTI_HH
+
+#include <cstddef>
+#include <algorithm>
+#include <numeric>
+#include <memory>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "cl-matrix-stream.hh"
+
+// Multiplication of host matrices on several devices at once. The result is split into square blocks,
+// and the blocks are dealt out in line order over a weighted round-robin sequence of the devices, where
+// each device appears in proportion to its measured speed. Each device then computes all its own blocks
+// in one streamed multiplication, from a separate host thread.
+class MultiDeviceMatrix
+{
+    protected:
+	std::vector<cl::Device> devices;
+	std::vector<cl::Context> contexts;
+	std::vector<std::unique_ptr<MatrixStream>> streams;
+	std::vector<double> speeds;
+
+    public:
+	MultiDeviceMatrix(std::vector<cl::Device> const &devices, cl_uint vectorWidth = 0u);
+
+	std::size_t deviceCount() const;
+	cl::Device const &device(std::size_t index) const;
+
+	// Single-device speed in GFLOPS, as measured by calibrate(), and used to weight the distribution
+	double deviceSpeed(std::size_t index) const;
+
+	// Time a few blockSize x blockSize result blocks on one line on each device in turn
+	template<typename FloatType>
+	    void calibrate(cl::size_type blockSize);
+
+	// Device index for each result block, in line order, weighted by the device speeds
+	std::vector<unsigned> distribution(std::size_t blockCount) const;
+
+	// result = m * n, for row-major host matrices, with blocks of blockSize lines and columns of the result
+	template<typename FloatType>
+	    void multiply(FloatType const *m, FloatType const *n, FloatType *result, cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type blockSize);
+};
+
+// Replace each CPU device that can be partitioned with subDeviceCount equal sub-devices, so a single
+// machine can run the multi-device multiplication
+extern std::vector<cl::Device> partition_cpu_devices(std::vector<cl::Device> const &devices, unsigned subDeviceCount);
+
+// Owner index for each of count items, from a smooth weighted round-robin: each step adds the weights to
+// the owner credits and picks the owner with the most credit, that then pays the total weight. Owners are
+// interleaved along the sequence, not grouped, with item counts in proportion to their weights.
+inline std::vector<unsigned> weighted_round_robin(std::vector<double> const &weights, std::size_t count)
+{
+    std::vector<unsigned> owners(count);
+    std::vector<double> credit(weights.size(), 0.0);
+    double const totalWeight = std::accumulate(weights.begin(), weights.end(), 0.0);
+
+    for (auto &owner: owners)
+    {
+	for (std::size_t i = 0u; i < credit.size(); i++)
+	    credit[i] += weights[i];
+
+	owner = static_cast<unsigned>(std::max_element(credit.begin(), credit.end()) - credit.begin());
+	credit[owner] -= totalWeight;
+    }
+
+    return owners;
+}
+
+// Regions of the result blocks with the given owner, for the owner of each block of a lines x cols result
+// in line order. The blocks on the last line and column are smaller for sizes that are not a multiple of
+// blockSize.
+inline std::vector<MatrixRegion> owned_blocks(std::vector<unsigned> const &owners, unsigned owner, cl::size_type lines, cl::size_type cols, cl::size_type blockSize)
+{
+    cl::size_type const blockCols = (cols + blockSize - 1u) / blockSize;
+    std::vector<MatrixRegion> regions;
+
+    for (std::size_t block = 0u; block < owners.size(); block++)
+	if (owners[block] == owner)
+	{
+	    cl::size_type const ib = block / blockCols * blockSize, jb = block % blockCols * blockSize;
+
+	    regions.push_back({ ib, jb, std::min(blockSize, lines - ib), std::min(blockSize, cols - jb) });
+	}
+
+    return regions;
+}
+
+inline std::size_t MultiDeviceMatrix::deviceCount() const
+{
+    return devices.size();
+}
+
+inline cl::Device const &MultiDeviceMatrix::device(std::size_t index) const
+{
+    return devices[index];
+}
+
+inline double MultiDeviceMatrix::deviceSpeed(std::size_t index) const
+{
+    return speeds[index];
+}
+
+#endif // !defined(CL_MATRIX_MULTI_HH)
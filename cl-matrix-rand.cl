@@ -1,38 +1,207 @@
 
+#if defined(cl_khr_fp64)
+# pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+#if defined(cl_khr_fp16)
+# pragma OPENCL EXTENSION cl_khr_fp16 : enable
+#endif
+
 #ifndef FLOAT_TYPE
 # ifdef cl_khr_fp64
-#  define FLOAT_TPYE double
+#  define FLOAT_TYPE double
 # else
 #  define FLOAT_TYPE float
 # endif
 #endif
 
+// Type for scalar kernel arguments and intermediate values, float for half matrices, double for quad
+#ifndef SCALAR_TYPE
+# define SCALAR_TYPE FLOAT_TYPE
+#endif
+
+#ifndef TILE_SIZE
+# define TILE_SIZE 32
+#endif
+
+#ifndef WORK_PER_ITEM
+# define WORK_PER_ITEM 4
+#endif
+
+#ifndef VECTOR_WIDTH
+# define VECTOR_WIDTH 1
+#endif
+
+#ifndef UNROLL
+# define UNROLL 1
+#endif
+
+#define COLS_PER_ITEM (WORK_PER_ITEM > VECTOR_WIDTH ? WORK_PER_ITEM : VECTOR_WIDTH)
+#define VECTORS_PER_ITEM (COLS_PER_ITEM / VECTOR_WIDTH)
+#define ITEM_TILE_LINES (TILE_SIZE / WORK_PER_ITEM)	    // work items along the lines of a tile
+#define ITEM_TILE_COLS  (TILE_SIZE / COLS_PER_ITEM)	    // work items along the columns of a tile
+
 #define	FLOAT_FUNCTION(name_prefix, floating_type, name_suffix) name_prefix ## floating_type ## name_suffix
 #define	FLOAT_FUNCTION_NAME(name_prefix, floating_type, name_suffix) FLOAT_FUNCTION(name_prefix, floating_type, name_suffix)
 
+#define PRAGMA_TEXT(text) _Pragma(#text)
+#define UNROLL_LOOP(count) PRAGMA_TEXT(unroll count)	    // #pragma unroll with macro-expanded count
+
+#define VECTOR_NAME(name, width) name ## width
+#define VECTOR_TYPE_NAME(name, width) VECTOR_NAME(name, width)
+
+// float, float2, ..., float16 and matching vloadn() / vstoren() functions, selected with -DVECTOR_WIDTH=n
+#if VECTOR_WIDTH == 1
+# define FLOAT_VECTOR FLOAT_TYPE
+# define VECTOR_LOAD(offset, pointer) ((pointer)[offset])
+# define VECTOR_STORE(value, offset, pointer) ((pointer)[offset] = (value))
+#else
+# define FLOAT_VECTOR VECTOR_TYPE_NAME(FLOAT_TYPE, VECTOR_WIDTH)
+# define VECTOR_LOAD VECTOR_TYPE_NAME(vload, VECTOR_WIDTH)
+# define VECTOR_STORE VECTOR_TYPE_NAME(vstore, VECTOR_WIDTH)
+#endif
+
+#if defined(DOUBLE_DOUBLE)
+
+// Emulated quad precision as an unevaluated sum of two doubles, high part in .s0, low part in .s1,
+// after "Library for Double-Double and Quad-Double Arithmetic", Y. Hida, X. S. Li, D. H. Bailey
+typedef double2 quad;
+
+quad quad_quick_two_sum(double a, double b);
+quad quad_two_sum(double a, double b);
+quad quad_add(quad a, quad b);
+quad quad_mul(quad a, quad b);
+
+quad quad_quick_two_sum(double a, double b)
+{
+    double const sum = a + b;
+
+    return (quad)(sum, b - (sum - a));
+}
+
+quad quad_two_sum(double a, double b)
+{
+    double const sum = a + b, b_part = sum - a;
+
+    return (quad)(sum, (a - (sum - b_part)) + (b - b_part));
+}
+
+quad quad_add(quad a, quad b)
+{
+    quad high = quad_two_sum(a.s0, b.s0), low = quad_two_sum(a.s1, b.s1);
+
+    high.s1 += low.s0;
+    high = quad_quick_two_sum(high.s0, high.s1);
+    high.s1 += low.s1;
+
+    return quad_quick_two_sum(high.s0, high.s1);
+}
+
+quad quad_mul(quad a, quad b)
+{
+    double const product = a.s0 * b.s0;
+    double error = fma(a.s0, b.s0, -product);
+
+    error += a.s0 * b.s1 + a.s1 * b.s0;
+
+    return quad_quick_two_sum(product, error);
+}
+
+# define MULTIPLY_ADD(a, b, c) quad_add(quad_mul(a, b), c)
+# define MULTIPLY(a, b) quad_mul(a, b)
+# define FROM_SCALAR(value) ((quad)((value), 0.0))
+# define TO_SCALAR(value) ((value).s0)
+
+#else
+
+# define MULTIPLY_ADD(a, b, c) mad(a, b, c)
+# define MULTIPLY(a, b) ((a) * (b))
+# define FROM_SCALAR(value) ((FLOAT_TYPE)(value))
+# define TO_SCALAR(value) ((SCALAR_TYPE)(value))
+
+#endif
+
+// Philox4x32-10 counter-based generator, from "Parallel Random Numbers: As Easy as 1, 2, 3",
+// J. K. Salmon, M. A. Moraes, R. O. Dror, D. E. Shaw. Maps a 128-bit counter and a 64-bit key to 4
+// random 32-bit values, so any work item can generate any part of the sequence, with no state
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+uint4 philox4x32_10(uint4 counter, uint2 key);
+
+uint4 philox4x32_10(uint4 counter, uint2 key)
+{
+    UNROLL_LOOP(10)
+    for (unsigned round = 0; round < 10; round++)
+    {
+	uint const
+	    hi0 = mul_hi(PHILOX_M0, counter.s0), lo0 = PHILOX_M0 * counter.s0,
+	    hi1 = mul_hi(PHILOX_M1, counter.s2), lo1 = PHILOX_M1 * counter.s2;
+
+	counter = (uint4)(hi1 ^ counter.s1 ^ key.s0, lo1, hi0 ^ counter.s3 ^ key.s1, lo0);
+	key += (uint2)(PHILOX_W0, PHILOX_W1);
+    }
+
+    return counter;
+}
+
+// Elements filled from one Philox block: 4 with 24-bit float (and half) samples, or 2 with 53-bit double
+// (and quad) samples. Must match MatrixKernels::randomFillSize() on the host
+#if defined(RANDOM_DOUBLE)
+# define RANDOM_PER_BLOCK 2
+#else
+# define RANDOM_PER_BLOCK 4
+#endif
+
+#if !defined(INTEGER_TYPE)
+
 // random_fill_float_block(...)
 // random_fill_double_block(...)
 //
-kernel void FLOAT_FUNCTION_NAME(random_fill_, float, _block)(global FLOAT_TYPE *matrix, ulong lines, ulong cols, FLOAT_TYPE minVal, FLOAT_TYPE maxVal)
+// Element i of the matrix (in line order) is taken from Philox block i / RANDOM_PER_BLOCK with counter
+// { block, stream } and key seed, so the result only depends on the seed and stream, for any device,
+// NDRange or element count. Uniform samples are exact, and the scaling to [minVal, maxVal) is done
+// without contraction into fma(), to round the same on all devices.
+//
+kernel void FLOAT_FUNCTION_NAME(random_fill_, FLOAT_TYPE, _block)(global FLOAT_TYPE *matrix, ulong lines, ulong cols, SCALAR_TYPE minVal, SCALAR_TYPE maxVal, ulong seed, ulong stream)
 {
-    ulong2 const work_item_size = (ulong2)( (lines + get_global_size(0) - 1) / get_global_size(0), (cols + get_global_size(1) - 1) / get_global_size(1));
-    unsigned const startLine = work_item_size.s0 * (get_global_id(0) - get_global_offset(0)) , startCol = work_item_size.s1 * (get_global_id(1) - get_global_offset(1));
-    unsigned shift_register = (startLine ? startLine : (unsigned)copysign(maxVal, 1.0f)) * (startCol ? startCol : (unsigned)copysign(maxVal, 1.0f)) + (startLine > startCol ? 8 : 3);
-    unsigned bit = 1;
+#pragma OPENCL FP_CONTRACT OFF
+
+    ulong const count = lines * cols;
+    uint2 const key = (uint2)((uint)seed, (uint)(seed >> 32));
+    SCALAR_TYPE const range = maxVal - minVal;
 
-    shift_register *= (startLine ? startLine : (unsigned)(maxVal - minVal) / 2) * (startCol ? startCol : (unsigned)(maxVal - minVal) / 2) + abs_diff(startCol, startLine) / 3;
+    for (ulong block = get_global_id(0); block * RANDOM_PER_BLOCK < count; block += get_global_size(0))
+    {
+	uint4 const random = philox4x32_10((uint4)((uint)block, (uint)(block >> 32), (uint)stream, (uint)(stream >> 32)), key);
+	ulong const index = block * RANDOM_PER_BLOCK;
 
-    for (unsigned int i = startLine; i < min(lines, startLine + work_item_size.s0); i++)
-	for (unsigned int j = startCol; j < min(cols, startCol + work_item_size.s1); j++)
+#if defined(RANDOM_DOUBLE)
+	SCALAR_TYPE const sample[RANDOM_PER_BLOCK] =
+	{
+	    (SCALAR_TYPE)(((ulong)random.s0 << 21) ^ (random.s1 >> 11)) * 0x1.0p-53,
+	    (SCALAR_TYPE)(((ulong)random.s2 << 21) ^ (random.s3 >> 11)) * 0x1.0p-53
+	};
+#else
+	SCALAR_TYPE const sample[RANDOM_PER_BLOCK] =
 	{
-	    bit  = ((shift_register >> 0) ^ (shift_register >> 3) ^ (shift_register >> 5) ^ (shift_register >> 8) ) & 0x0001U;
-	    shift_register =  (shift_register >> 1) | (shift_register << 31);
+	    (SCALAR_TYPE)(random.s0 >> 8) * 0x1.0p-24f,
+	    (SCALAR_TYPE)(random.s1 >> 8) * 0x1.0p-24f,
+	    (SCALAR_TYPE)(random.s2 >> 8) * 0x1.0p-24f,
+	    (SCALAR_TYPE)(random.s3 >> 8) * 0x1.0p-24f
+	};
+#endif
 
-	    matrix[i * cols + j] = minVal + fmod((FLOAT_TYPE)(shift_register) / 100, maxVal - minVal);
-	}
+	UNROLL_LOOP(RANDOM_PER_BLOCK)
+	for (unsigned k = 0; k < RANDOM_PER_BLOCK; k++)
+	    if (index + k < count)
+		matrix[index + k] = FROM_SCALAR(minVal + sample[k] * range);
+    }
 }
 
-// multipy_float_matrix_block()
+// multiply_float_matrix_block()
 // multiply_double_matrix_block()
 //
 kernel void FLOAT_FUNCTION_NAME(multiply_, FLOAT_TYPE, _matrix_block)
@@ -50,10 +219,459 @@ kernel void FLOAT_FUNCTION_NAME(multiply_, FLOAT_TYPE, _matrix_block)
 	    for (unsigned i = startLine; i < min(result_lines, startLine + work_item_size.s0); i++)
 		for (unsigned j = startCol; j < min(result_cols, startCol + work_item_size.s1); j++)
 		    for (unsigned k = 0; k < m_cols; k++)
-			result[i * result_cols + j] += m[i * m_lines + k] * n[k * n_lines + j];
+			result[i * result_cols + j] = MULTIPLY_ADD(m[i * m_cols + k], n[k * n_cols + j], result[i * result_cols + j]);
+    }
+}
+
+// multiply_float_matrix_tile()
+// multiply_double_matrix_tile()
+//
+// Each work group computes one TILE_SIZE x TILE_SIZE tile of the result, staging the matching tiles from
+// m and n through local memory. Each work item accumulates WORK_PER_ITEM lines by COLS_PER_ITEM columns of
+// the tile in private memory, as VECTOR_WIDTH-wide vectors. Lines and column vectors of a work item are
+// strided by the work group size, so neighbouring work items access neighbouring addresses. NDRange
+// dimension 0 runs over the result columns, dimension 1 over the result lines. All matrices are dense and
+// row-major, of any size.
+//
+// Computes result = alpha * op(m) * op(n) + beta * result, where op(m) is lines x inner and op(n) is
+// inner x cols, and op() transposes the stored matrix if the matching transpose flag is set. The result
+// is scaled as it is stored, and is not read at all when beta is 0, so it needs no fill pass before.
+//
+kernel __attribute__((reqd_work_group_size(ITEM_TILE_COLS, ITEM_TILE_LINES, 1)))
+    void FLOAT_FUNCTION_NAME(multiply_, FLOAT_TYPE, _matrix_tile)
+    (
+	global FLOAT_TYPE const *m, uint transpose_m,
+	global FLOAT_TYPE const *n, uint transpose_n,
+	global FLOAT_TYPE *result, ulong lines, ulong inner, ulong cols,
+	SCALAR_TYPE alpha, SCALAR_TYPE beta
+    )
+{
+    local FLOAT_TYPE mTile[TILE_SIZE][TILE_SIZE], nTile[TILE_SIZE][TILE_SIZE];
+    FLOAT_VECTOR acc[WORK_PER_ITEM][VECTORS_PER_ITEM];
+
+    unsigned const localCol = get_local_id(0), localLine = get_local_id(1);
+    unsigned const localId = localLine * ITEM_TILE_COLS + localCol;
+    ulong const tileCol = get_group_id(0) * TILE_SIZE, tileLine = get_group_id(1) * TILE_SIZE;
+
+    for (unsigned i = 0; i < WORK_PER_ITEM; i++)
+	for (unsigned j = 0; j < VECTORS_PER_ITEM; j++)
+	    acc[i][j] = (FLOAT_VECTOR)(0);
+
+    for (ulong tileK = 0; tileK < inner; tileK += TILE_SIZE)
+    {
+	// line and col run over the stored matrix, so transposed tiles are also loaded along memory lines
+	for (unsigned index = localId; index < TILE_SIZE * TILE_SIZE; index += ITEM_TILE_COLS * ITEM_TILE_LINES)
+	{
+	    unsigned const line = index / TILE_SIZE, col = index % TILE_SIZE;
+
+	    if (transpose_m)
+		mTile[col][line] = tileK + line < inner && tileLine + col < lines ? m[(tileK + line) * lines + tileLine + col] : (FLOAT_TYPE)(0);
+	    else
+		mTile[line][col] = tileLine + line < lines && tileK + col < inner ? m[(tileLine + line) * inner + tileK + col] : (FLOAT_TYPE)(0);
+
+	    if (transpose_n)
+		nTile[col][line] = tileCol + line < cols && tileK + col < inner ? n[(tileCol + line) * inner + tileK + col] : (FLOAT_TYPE)(0);
+	    else
+		nTile[line][col] = tileK + line < inner && tileCol + col < cols ? n[(tileK + line) * cols + tileCol + col] : (FLOAT_TYPE)(0);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	UNROLL_LOOP(UNROLL)
+	for (unsigned k = 0; k < TILE_SIZE; k++)
+	{
+	    FLOAT_VECTOR nReg[VECTORS_PER_ITEM];
+
+	    for (unsigned j = 0; j < VECTORS_PER_ITEM; j++)
+		nReg[j] = VECTOR_LOAD(0, &nTile[k][(localCol + j * ITEM_TILE_COLS) * VECTOR_WIDTH]);
+
+	    for (unsigned i = 0; i < WORK_PER_ITEM; i++)
+	    {
+		FLOAT_VECTOR const mReg = (FLOAT_VECTOR)(mTile[localLine + i * ITEM_TILE_LINES][k]);
+
+		for (unsigned j = 0; j < VECTORS_PER_ITEM; j++)
+		    acc[i][j] = MULTIPLY_ADD(mReg, nReg[j], acc[i][j]);
+	    }
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    FLOAT_VECTOR const alphaVector = (FLOAT_VECTOR)(FROM_SCALAR(alpha)), betaVector = (FLOAT_VECTOR)(FROM_SCALAR(beta));
+
+    for (unsigned i = 0; i < WORK_PER_ITEM; i++)
+    {
+	ulong const line = tileLine + localLine + i * ITEM_TILE_LINES;
+
+	if (line < lines)
+	    for (unsigned j = 0; j < VECTORS_PER_ITEM; j++)
+	    {
+		ulong const col = tileCol + (localCol + j * ITEM_TILE_COLS) * VECTOR_WIDTH;
+		global FLOAT_TYPE *resultLine = result + line * cols;
+		FLOAT_VECTOR const product = MULTIPLY(alphaVector, acc[i][j]);
+
+		if (col + VECTOR_WIDTH <= cols)
+		    VECTOR_STORE(beta != 0 ? MULTIPLY_ADD(betaVector, VECTOR_LOAD(0, resultLine + col), product) : product, 0, resultLine + col);
+		else
+		{
+		    FLOAT_TYPE productElements[VECTOR_WIDTH];
+
+		    VECTOR_STORE(product, 0, productElements);
+
+		    for (unsigned v = 0; col + v < cols; v++)
+			resultLine[col + v] = beta != 0 ? MULTIPLY_ADD(FROM_SCALAR(beta), resultLine[col + v], productElements[v]) : productElements[v];
+		}
+	    }
     }
 }
 
+// SCALAR_TYPE vectors, and vload_halfn() / vstoren_half() functions, for matrices stored as half
+#if VECTOR_WIDTH == 1
+# define SCALAR_VECTOR SCALAR_TYPE
+# define HALF_VECTOR_LOAD vload_half
+# define HALF_VECTOR_STORE vstore_half
+#else
+# define SCALAR_VECTOR VECTOR_TYPE_NAME(SCALAR_TYPE, VECTOR_WIDTH)
+# define HALF_VECTOR_LOAD VECTOR_TYPE_NAME(vload_half, VECTOR_WIDTH)
+# define HALF_VECTOR_STORE VECTOR_TYPE_NAME(vstore_half, VECTOR_WIDTH)
+#endif
+
+#define CONVERT_SCALAR_VECTOR VECTOR_TYPE_NAME(convert_, SCALAR_VECTOR)
+
+// multiply_float_half_tile()
+// multiply_double_half_tile()
+//
+// Same as the _matrix_tile kernel, for matrices stored as half, with the tiles and the sums in SCALAR_TYPE
+// (float in the float and half programs). Elements are only converted by vload_half() and vstore_half(),
+// so no half arithmetic is used, and the kernel needs no cl_khr_fp16 support.
+//
+kernel __attribute__((reqd_work_group_size(ITEM_TILE_COLS, ITEM_TILE_LINES, 1)))
+    void FLOAT_FUNCTION_NAME(multiply_, FLOAT_TYPE, _half_tile)
+    (
+	global half const *m, uint transpose_m,
+	global half const *n, uint transpose_n,
+	global half *result, ulong lines, ulong inner, ulong cols,
+	SCALAR_TYPE alpha, SCALAR_TYPE beta
+    )
+{
+    local SCALAR_TYPE mTile[TILE_SIZE][TILE_SIZE], nTile[TILE_SIZE][TILE_SIZE];
+    SCALAR_VECTOR acc[WORK_PER_ITEM][VECTORS_PER_ITEM];
+
+    unsigned const localCol = get_local_id(0), localLine = get_local_id(1);
+    unsigned const localId = localLine * ITEM_TILE_COLS + localCol;
+    ulong const tileCol = get_group_id(0) * TILE_SIZE, tileLine = get_group_id(1) * TILE_SIZE;
+
+    for (unsigned i = 0; i < WORK_PER_ITEM; i++)
+	for (unsigned j = 0; j < VECTORS_PER_ITEM; j++)
+	    acc[i][j] = (SCALAR_VECTOR)(0);
+
+    for (ulong tileK = 0; tileK < inner; tileK += TILE_SIZE)
+    {
+	for (unsigned index = localId; index < TILE_SIZE * TILE_SIZE; index += ITEM_TILE_COLS * ITEM_TILE_LINES)
+	{
+	    unsigned const line = index / TILE_SIZE, col = index % TILE_SIZE;
+
+	    if (transpose_m)
+		mTile[col][line] = tileK + line < inner && tileLine + col < lines ? vload_half((tileK + line) * lines + tileLine + col, m) : 0;
+	    else
+		mTile[line][col] = tileLine + line < lines && tileK + col < inner ? vload_half((tileLine + line) * inner + tileK + col, m) : 0;
+
+	    if (transpose_n)
+		nTile[col][line] = tileCol + line < cols && tileK + col < inner ? vload_half((tileCol + line) * inner + tileK + col, n) : 0;
+	    else
+		nTile[line][col] = tileK + line < inner && tileCol + col < cols ? vload_half((tileK + line) * cols + tileCol + col, n) : 0;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	UNROLL_LOOP(UNROLL)
+	for (unsigned k = 0; k < TILE_SIZE; k++)
+	{
+	    SCALAR_VECTOR nReg[VECTORS_PER_ITEM];
+
+	    for (unsigned j = 0; j < VECTORS_PER_ITEM; j++)
+		nReg[j] = VECTOR_LOAD(0, &nTile[k][(localCol + j * ITEM_TILE_COLS) * VECTOR_WIDTH]);
+
+	    for (unsigned i = 0; i < WORK_PER_ITEM; i++)
+	    {
+		SCALAR_VECTOR const mReg = (SCALAR_VECTOR)(mTile[localLine + i * ITEM_TILE_LINES][k]);
+
+		for (unsigned j = 0; j < VECTORS_PER_ITEM; j++)
+		    acc[i][j] = mad(mReg, nReg[j], acc[i][j]);
+	    }
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (unsigned i = 0; i < WORK_PER_ITEM; i++)
+    {
+	ulong const line = tileLine + localLine + i * ITEM_TILE_LINES;
+
+	if (line < lines)
+	    for (unsigned j = 0; j < VECTORS_PER_ITEM; j++)
+	    {
+		ulong const col = tileCol + (localCol + j * ITEM_TILE_COLS) * VECTOR_WIDTH;
+		global half *resultLine = result + line * cols;
+		SCALAR_VECTOR const product = alpha * acc[i][j];
+
+		if (col + VECTOR_WIDTH <= cols)
+		    HALF_VECTOR_STORE(beta != 0 ? mad((SCALAR_VECTOR)(beta), CONVERT_SCALAR_VECTOR(HALF_VECTOR_LOAD(0, resultLine + col)), product) : product, 0, resultLine + col);
+		else
+		{
+		    SCALAR_TYPE productElements[VECTOR_WIDTH];
+
+		    VECTOR_STORE(product, 0, productElements);
+
+		    for (unsigned v = 0; col + v < cols; v++)
+			vstore_half(beta != 0 ? mad(beta, (SCALAR_TYPE)(vload_half(col + v, resultLine)), productElements[v]) : productElements[v], col + v, resultLine);
+		}
+	    }
+    }
+}
+
+// convert_float_to_half()
+// convert_double_to_half()
+//
+// Store count elements of a matrix as half, rounded to nearest even
+//
+kernel void FLOAT_FUNCTION_NAME(convert_, FLOAT_TYPE, _to_half)(global FLOAT_TYPE const *matrix, global half *result, ulong count)
+{
+    for (ulong i = get_global_id(0); i < count; i += get_global_size(0))
+	vstore_half(TO_SCALAR(matrix[i]), i, result);
+}
+
+// matrix_float_add()
+// matrix_double_add()
+//
+// result = a + scale * b, for count elements, as used for the sums of quadrants in the Strassen-Winograd
+// multiplication. result may be the same buffer as a or b.
+//
+kernel void FLOAT_FUNCTION_NAME(matrix_, FLOAT_TYPE, _add)(global FLOAT_TYPE const *a, global FLOAT_TYPE const *b, global FLOAT_TYPE *result, ulong count, SCALAR_TYPE scale)
+{
+    FLOAT_TYPE const factor = FROM_SCALAR(scale);
+
+    for (ulong i = get_global_id(0); i < count; i += get_global_size(0))
+	result[i] = MULTIPLY_ADD(factor, b[i], a[i]);
+}
+
+// Batched products of small matrices: result[b] = m[b] * n[b] for b < batch_count, all lines x inner by
+// inner x cols, dense and row-major. Matrix b starts at element offsets[3 * b] in m, offsets[3 * b + 1] in
+// n and offsets[3 * b + 2] in result if offsets is given (not NULL), or at b times the given stride.
+// The result is overwritten, not accumulated.
+//
+#define BATCH_MATRIX(matrix, b, stride, offsets, index) ((matrix) + ((offsets) ? (offsets)[3 * (b) + (index)] : (b) * (stride)))
+
+// multiply_float_batch_item()
+// multiply_double_batch_item()
+//
+// One work item for each product, for matrices so small that a work group per product would idle.
+//
+kernel void FLOAT_FUNCTION_NAME(multiply_, FLOAT_TYPE, _batch_item)
+    (
+	global FLOAT_TYPE const *m, ulong m_stride,
+	global FLOAT_TYPE const *n, ulong n_stride,
+	global FLOAT_TYPE *result, ulong result_stride,
+	global ulong const *offsets, ulong lines, ulong inner, ulong cols, ulong batch_count
+    )
+{
+    ulong const b = get_global_id(0);
+
+    if (b < batch_count)
+    {
+	global FLOAT_TYPE const *batchM = BATCH_MATRIX(m, b, m_stride, offsets, 0);
+	global FLOAT_TYPE const *batchN = BATCH_MATRIX(n, b, n_stride, offsets, 1);
+	global FLOAT_TYPE *batchResult = BATCH_MATRIX(result, b, result_stride, offsets, 2);
+
+	for (ulong i = 0; i < lines; i++)
+	    for (ulong j = 0; j < cols; j++)
+	    {
+		FLOAT_TYPE acc = (FLOAT_TYPE)(0);
+
+		for (ulong k = 0; k < inner; k++)
+		    acc = MULTIPLY_ADD(batchM[i * inner + k], batchN[k * cols + j], acc);
+
+		batchResult[i * cols + j] = acc;
+	    }
+    }
+}
+
+#ifndef BATCH_TILE
+# define BATCH_TILE 16
+#endif
+
+// multiply_float_batch_group()
+// multiply_double_batch_group()
+//
+// One BATCH_TILE x BATCH_TILE work group for each product, that runs over the result in tiles, with the
+// tiles of m and n staged through local memory. NDRange dimension 0 runs over the products.
+//
+kernel __attribute__((reqd_work_group_size(BATCH_TILE, BATCH_TILE, 1)))
+    void FLOAT_FUNCTION_NAME(multiply_, FLOAT_TYPE, _batch_group)
+    (
+	global FLOAT_TYPE const *m, ulong m_stride,
+	global FLOAT_TYPE const *n, ulong n_stride,
+	global FLOAT_TYPE *result, ulong result_stride,
+	global ulong const *offsets, ulong lines, ulong inner, ulong cols, ulong batch_count
+    )
+{
+    local FLOAT_TYPE mTile[BATCH_TILE][BATCH_TILE], nTile[BATCH_TILE][BATCH_TILE];
+
+    ulong const b = get_group_id(0);
+    unsigned const col = get_local_id(0), line = get_local_id(1);
+
+    if (b >= batch_count)
+	return;
+
+    global FLOAT_TYPE const *batchM = BATCH_MATRIX(m, b, m_stride, offsets, 0);
+    global FLOAT_TYPE const *batchN = BATCH_MATRIX(n, b, n_stride, offsets, 1);
+    global FLOAT_TYPE *batchResult = BATCH_MATRIX(result, b, result_stride, offsets, 2);
+
+    for (ulong tileLine = 0; tileLine < lines; tileLine += BATCH_TILE)
+	for (ulong tileCol = 0; tileCol < cols; tileCol += BATCH_TILE)
+	{
+	    FLOAT_TYPE acc = (FLOAT_TYPE)(0);
+
+	    for (ulong tileK = 0; tileK < inner; tileK += BATCH_TILE)
+	    {
+		mTile[line][col] = tileLine + line < lines && tileK + col < inner ? batchM[(tileLine + line) * inner + tileK + col] : (FLOAT_TYPE)(0);
+		nTile[line][col] = tileK + line < inner && tileCol + col < cols ? batchN[(tileK + line) * cols + tileCol + col] : (FLOAT_TYPE)(0);
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		for (unsigned k = 0; k < BATCH_TILE; k++)
+		    acc = MULTIPLY_ADD(mTile[line][k], nTile[k][col], acc);
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+	    }
+
+	    if (tileLine + line < lines && tileCol + col < cols)
+		batchResult[(tileLine + line) * cols + tileCol + col] = acc;
+	}
+}
+
+#else // defined(INTEGER_TYPE)
+
+// Integer matrix multiplication, built with -DINTEGER_TYPE=char or short, and matching INTEGER_BITS of 8
+// or 16, with int products and sums
+
+#define INTEGER_VECTOR4 VECTOR_TYPE_NAME(INTEGER_TYPE, 4)
+
+int dot4(INTEGER_VECTOR4 a, INTEGER_VECTOR4 b);
+
+// Sum of the products of 4 pairs of elements: with the dot product built-in from cl_khr_integer_dot_product
+// for char elements, if the device has it and the program is built for OpenCL C 3.0, or else with packed
+// arithmetic, where the products of chars fit in a short vector
+int dot4(INTEGER_VECTOR4 a, INTEGER_VECTOR4 b)
+{
+#if INTEGER_BITS == 8 && defined(cl_khr_integer_dot_product) && defined(__opencl_c_integer_dot_product_input_4x8bit)
+    return dot(a, b);
+#elif INTEGER_BITS == 8
+    short4 const product = convert_short4(a) * convert_short4(b);
+
+    return (int)product.s0 + product.s1 + product.s2 + product.s3;
+#else
+    int4 const product = convert_int4(a) * convert_int4(b);
+
+    return product.s0 + product.s1 + product.s2 + product.s3;
+#endif
+}
+
+// random_fill_char_block(...)
+// random_fill_short_block(...)
+//
+// Uniform elements in [minVal, maxVal], with element i taken from Philox block i / 4, as for the float
+// matrices, so the result only depends on the seed and stream
+//
+kernel void FLOAT_FUNCTION_NAME(random_fill_, INTEGER_TYPE, _block)(global INTEGER_TYPE *matrix, ulong lines, ulong cols, int minVal, int maxVal, ulong seed, ulong stream)
+{
+    ulong const count = lines * cols;
+    uint2 const key = (uint2)((uint)seed, (uint)(seed >> 32));
+    uint const range = (uint)(maxVal - minVal) + 1u;
+
+    for (ulong block = get_global_id(0); block * 4 < count; block += get_global_size(0))
+    {
+	uint4 const sample = philox4x32_10((uint4)((uint)block, (uint)(block >> 32), (uint)stream, (uint)(stream >> 32)), key);
+	uint const samples[4] = { sample.s0, sample.s1, sample.s2, sample.s3 };
+
+	for (unsigned k = 0; k < 4 && block * 4 + k < count; k++)
+	    matrix[block * 4 + k] = (INTEGER_TYPE)(minVal + (int)(range ? samples[k] % range : samples[k]));
+    }
+}
+
+// multiply_char_tile()
+// multiply_short_tile()
+//
+// result = m * n, for dense, row-major lines x inner and inner x cols integer matrices, and an int result.
+// Work groups and tiles as for the _matrix_tile kernel, with the COLS_PER_ITEM columns of a work item
+// strided by the work group size. The n tile is transposed in local memory, so both tiles have 4
+// consecutive elements along the inner dimension for each dot product.
+//
+kernel __attribute__((reqd_work_group_size(ITEM_TILE_COLS, ITEM_TILE_LINES, 1)))
+    void FLOAT_FUNCTION_NAME(multiply_, INTEGER_TYPE, _tile)
+    (
+	global INTEGER_TYPE const *m, global INTEGER_TYPE const *n, global int *result, ulong lines, ulong inner, ulong cols
+    )
+{
+    local INTEGER_TYPE mTile[TILE_SIZE][TILE_SIZE], nTile[TILE_SIZE][TILE_SIZE];
+    int acc[WORK_PER_ITEM][COLS_PER_ITEM];
+
+    unsigned const localCol = get_local_id(0), localLine = get_local_id(1);
+    unsigned const localId = localLine * ITEM_TILE_COLS + localCol;
+    ulong const tileCol = get_group_id(0) * TILE_SIZE, tileLine = get_group_id(1) * TILE_SIZE;
+
+    for (unsigned i = 0; i < WORK_PER_ITEM; i++)
+	for (unsigned j = 0; j < COLS_PER_ITEM; j++)
+	    acc[i][j] = 0;
+
+    for (ulong tileK = 0; tileK < inner; tileK += TILE_SIZE)
+    {
+	for (unsigned index = localId; index < TILE_SIZE * TILE_SIZE; index += ITEM_TILE_COLS * ITEM_TILE_LINES)
+	{
+	    unsigned const line = index / TILE_SIZE, col = index % TILE_SIZE;
+
+	    mTile[line][col] = tileLine + line < lines && tileK + col < inner ? m[(tileLine + line) * inner + tileK + col] : 0;
+	    nTile[col][line] = tileK + line < inner && tileCol + col < cols ? n[(tileK + line) * cols + tileCol + col] : 0;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (unsigned k = 0; k < TILE_SIZE; k += 4)
+	{
+	    INTEGER_VECTOR4 nReg[COLS_PER_ITEM];
+
+	    for (unsigned j = 0; j < COLS_PER_ITEM; j++)
+		nReg[j] = vload4(0, &nTile[localCol + j * ITEM_TILE_COLS][k]);
+
+	    for (unsigned i = 0; i < WORK_PER_ITEM; i++)
+	    {
+		INTEGER_VECTOR4 const mReg = vload4(0, &mTile[localLine + i * ITEM_TILE_LINES][k]);
+
+		for (unsigned j = 0; j < COLS_PER_ITEM; j++)
+		    acc[i][j] += dot4(mReg, nReg[j]);
+	    }
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (unsigned i = 0; i < WORK_PER_ITEM; i++)
+    {
+	ulong const line = tileLine + localLine + i * ITEM_TILE_LINES;
+
+	if (line < lines)
+	    for (unsigned j = 0; j < COLS_PER_ITEM; j++)
+	    {
+		ulong const col = tileCol + localCol + j * ITEM_TILE_COLS;
+
+		if (col < cols)
+		    result[line * cols + col] = acc[i][j];
+	    }
+    }
+}
+
+#endif // defined(INTEGER_TYPE)
+
 /*
  * vi:ft=opencl:ts=8
  */
@@ -0,0 +1,342 @@
+#include <cstddef>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include <map>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "cl-matrix-mult.hh"
+#include "cl-matrix-strassen.hh"
+
+using std::min;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+using cl::Context;
+using cl::CommandQueue;
+using cl::Buffer;
+using cl::Event;
+using cl::EnqueueArgs;
+using cl::NDRange;
+
+static cl::size_type const
+    STRASSEN_TUNE_MIN_SIZE = 256u,	    // crossover sizes tried, for matrices of twice the size
+    STRASSEN_TUNE_MAX_SIZE = 4096u;
+
+static unsigned const STRASSEN_TUNE_PASS_COUNT = 2u;
+
+// The commands for one multiplication in the recursive layout, each waiting for the one before
+template<typename FloatType>
+    class StrassenRecursion
+{
+    public:
+	typedef typename MatrixScalar<FloatType>::type ScalarType;
+
+	struct Block
+	{
+	    Buffer *buffer;
+	    cl::size_type offset;	    // in elements
+	};
+
+	StrassenRecursion(MatrixKernels<FloatType> &kernels, CommandQueue &queue, cl::size_type leafSize, vector<Event> const &dependencies);
+
+	// c = a * b, for size x size blocks, with temporary quadrants from work
+	void multiply(Block a, Block b, Block c, cl::size_type size, Block work);
+
+	vector<Event> const &lastEvent() const;
+
+    protected:
+	MatrixKernels<FloatType> &kernels;
+	CommandQueue &queue;
+	cl::size_type leafSize;
+	vector<Event> last;
+	std::map<std::tuple<cl_mem, cl::size_type, cl::size_type>, Buffer> subBuffers;
+
+	Buffer &subBuffer(Block block, cl::size_type count);
+
+	// result = a + scale * b, for count elements
+	void add(Block a, Block b, Block result, cl::size_type count, ScalarType scale);
+
+	static Block quadrant(Block block, cl::size_type size, unsigned index);
+};
+
+template<typename FloatType>
+    StrassenRecursion<FloatType>::StrassenRecursion(MatrixKernels<FloatType> &kernels, CommandQueue &queue, cl::size_type leafSize, vector<Event> const &dependencies)
+	: kernels(kernels), queue(queue), leafSize(leafSize), last(dependencies)
+{
+}
+
+template<typename FloatType>
+    inline vector<Event> const &StrassenRecursion<FloatType>::lastEvent() const
+{
+    return last;
+}
+
+// One sub-buffer for each region, so a region that is both read and written by a command is passed as
+// the same buffer, and never as two overlapping sub-buffers
+template<typename FloatType>
+    Buffer &StrassenRecursion<FloatType>::subBuffer(Block block, cl::size_type count)
+{
+    auto key = std::make_tuple((*block.buffer)(), block.offset, count);
+    auto it = subBuffers.find(key);
+
+    if (it == subBuffers.end())
+    {
+	cl_buffer_region const region = { block.offset * sizeof(FloatType), count * sizeof(FloatType) };
+
+	it = subBuffers.emplace(key, block.buffer->createSubBuffer(CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region)).first;
+    }
+
+    return it->second;
+}
+
+template<typename FloatType>
+    inline typename StrassenRecursion<FloatType>::Block StrassenRecursion<FloatType>::quadrant(Block block, cl::size_type size, unsigned index)
+{
+    return { block.buffer, block.offset + index * (size / 2u) * (size / 2u) };
+}
+
+template<typename FloatType>
+    void StrassenRecursion<FloatType>::add(Block a, Block b, Block result, cl::size_type count, ScalarType scale)
+{
+    Event event = kernels.matrix_add(EnqueueArgs(queue, last, NDRange(count)), subBuffer(a, count), subBuffer(b, count), subBuffer(result, count), count, scale);
+
+    last.assign(1u, event);
+}
+
+// Winograd's variant, scheduled with only two temporary quadrants X and Y for each level, and the result
+// quadrants holding the partial products:
+//	S1 = A21 + A22,	S2 = S1 - A11,	S3 = A11 - A21,	S4 = A12 - S2
+//	T1 = B12 - B11,	T2 = B22 - T1,	T3 = B22 - B12,	T4 = T2 - B21
+//	P1 = A11 B11,	P2 = A12 B21,	P3 = S4 B22,	P4 = A22 T4,	P5 = S1 T1,	P6 = S2 T2,	P7 = S3 T3
+//	U2 = P1 + P6,	U3 = U2 + P7,	U4 = U2 + P5
+//	C11 = P1 + P2,	C12 = U4 + P3,	C21 = U3 - P4,	C22 = U3 + P5
+template<typename FloatType>
+    void StrassenRecursion<FloatType>::multiply(Block a, Block b, Block c, cl::size_type size, Block work)
+{
+    if (size <= leafSize)
+    {
+	cl::size_type const count = size * size;
+	Event event = kernels.multiply_matrix_tile
+	    (
+		EnqueueArgs(queue, last, kernels.globalSize(size, size), kernels.localSize()),
+		subBuffer(a, count), false, subBuffer(b, count), false, subBuffer(c, count), size, size, size, 1, 0
+	    );
+
+	last.assign(1u, event);
+
+	return;
+    }
+
+    cl::size_type const half = size / 2u, count = half * half;
+
+    Block const
+	a11 = quadrant(a, size, 0u), a12 = quadrant(a, size, 1u), a21 = quadrant(a, size, 2u), a22 = quadrant(a, size, 3u),
+	b11 = quadrant(b, size, 0u), b12 = quadrant(b, size, 1u), b21 = quadrant(b, size, 2u), b22 = quadrant(b, size, 3u),
+	c11 = quadrant(c, size, 0u), c12 = quadrant(c, size, 1u), c21 = quadrant(c, size, 2u), c22 = quadrant(c, size, 3u),
+	x = work, y = { work.buffer, work.offset + count }, next = { work.buffer, work.offset + 2u * count };
+
+    add(a11, a21, x, count, -1);	    // X = S3
+    add(b22, b12, y, count, -1);	    // Y = T3
+    multiply(x, y, c21, half, next);	    // C21 = P7
+    add(a21, a22, x, count, 1);		    // X = S1
+    add(b12, b11, y, count, -1);	    // Y = T1
+    multiply(x, y, c22, half, next);	    // C22 = P5
+    add(x, a11, x, count, -1);		    // X = S2
+    add(b22, y, y, count, -1);		    // Y = T2
+    multiply(x, y, c12, half, next);	    // C12 = P6
+    add(a12, x, x, count, -1);		    // X = S4
+    multiply(x, b22, c11, half, next);	    // C11 = P3
+    multiply(a11, b11, x, half, next);	    // X = P1
+    add(x, c12, c12, count, 1);		    // C12 = U2
+    add(c12, c21, c21, count, 1);	    // C21 = U3
+    add(c12, c22, c12, count, 1);	    // C12 = U4
+    add(c21, c22, c22, count, 1);	    // C22 = U3 + P5
+    add(c12, c11, c12, count, 1);	    // C12 = U4 + P3
+    add(y, b21, y, count, -1);		    // Y = T4
+    multiply(a22, y, c11, half, next);	    // C11 = P4
+    add(c21, c11, c21, count, -1);	    // C21 = U3 - P4
+    multiply(a12, b21, c11, half, next);    // C11 = P2
+    add(x, c11, c11, count, 1);		    // C11 = P1 + P2
+}
+
+MatrixStrassen::MatrixStrassen(Context &context, cl_uint vectorWidth, cl_command_queue_properties queueProperties)
+    : Matrix(context, vectorWidth, queueProperties)
+{
+}
+
+template<typename FloatType>
+    bool MatrixStrassen::fits(cl::size_type size, unsigned bufferCount)
+{
+    cl::size_type const bufferSize = size * size * sizeof(FloatType);
+
+    // The 3 copies in the recursive layout, and the temporary quadrants, that take less than one more buffer
+    return bufferSize <= device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>() && (bufferCount + 4u) * bufferSize <= device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 2u;
+}
+
+// Time the direct multiplication of 2s x 2s matrices against one level of recursion, down to the direct
+// multiplication of s x s quadrants, for increasing s. The crossover is the first s for which the
+// recursion is faster, or twice the largest s tried if it never is. Returns 0, for the direct kernel only,
+// if not even the smallest size fits in the device memory, so nothing could be timed.
+template<typename FloatType>
+    cl::size_type MatrixStrassen::tuneCrossover()
+{
+    cl::size_type crossover = STRASSEN_TUNE_MIN_SIZE;
+
+    if (!fits<FloatType>(2u * crossover, 3u))
+	return 0u;
+
+    for (; crossover <= STRASSEN_TUNE_MAX_SIZE && fits<FloatType>(2u * crossover, 3u); crossover *= 2u)
+    {
+	cl::size_type const size = 2u * crossover;
+
+	Buffer
+	    m = createBuffer<FloatType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS),
+	    n = createBuffer<FloatType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS),
+	    result = createBuffer<FloatType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS);
+
+	random_fill<FloatType>(m, size, size, -1.0f, 1.0f, size, 0u);
+	random_fill<FloatType>(n, size, size, -1.0f, 1.0f, size, 1u);
+
+	auto bestTime = [this](auto multiply)
+	{
+	    double best = 0.0;
+
+	    // The first run includes building the kernels
+	    for (unsigned pass = 0u; pass <= STRASSEN_TUNE_PASS_COUNT; pass++)
+	    {
+		auto const startTime = steady_clock::now();
+
+		multiply();
+		waitForCompletion();
+
+		double const time = duration<double>(steady_clock::now() - startTime).count();
+
+		if (pass)
+		    best = pass > 1u ? min(best, time) : time;
+	    }
+
+	    return best;
+	};
+
+	double const
+	    directTime = bestTime([&]() { gemm<FloatType>(false, false, size, size, size, 1, m, n, 0, result); }),
+	    strassenTime = bestTime([&]() { multiply_strassen<FloatType>(m, n, result, size, crossover); });
+
+	if (strassenTime < directTime)
+	    break;
+    }
+
+    return crossover;
+}
+
+template<typename FloatType>
+    cl::Event MatrixStrassen::multiply_strassen(cl::Buffer const &m, cl::Buffer const &n, cl::Buffer &result, cl::size_type size, cl::size_type crossover)
+{
+    unsigned const depth = recursionDepth(size, crossover ? crossover : this->crossover<FloatType>());
+
+    if (!depth)
+	return gemm<FloatType>(false, false, size, size, size, 1, m, n, 0, result);
+
+    // Leaf blocks are a multiple of the kernel tile size, and start at aligned offsets for the sub-buffers
+    cl::size_type const tileSize = gemmConfig<FloatType>().tileSize, baseAlign = device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8u;
+    cl::size_type leafSize = (((size + (cl::size_type(1u) << depth) - 1u) >> depth) + tileSize - 1u) / tileSize * tileSize;
+
+    while (leafSize * leafSize * sizeof(FloatType) % baseAlign)
+	leafSize += tileSize;
+
+    cl::size_type const paddedSize = leafSize << depth, leafCount = (size + leafSize - 1u) / leafSize, leafPitch = leafSize * sizeof(FloatType);
+    cl::size_type workSize = 0u;
+
+    for (unsigned level = 1u; level <= depth; level++)
+	workSize += 2u * (paddedSize >> level) * (paddedSize >> level);
+
+    Buffer
+	packedM(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, paddedSize * paddedSize * sizeof(FloatType)),
+	packedN(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, paddedSize * paddedSize * sizeof(FloatType)),
+	packedResult(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, paddedSize * paddedSize * sizeof(FloatType)),
+	work(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, workSize * sizeof(FloatType));
+
+    vector<Event> dependencies, packed;
+
+    readDependencies(m, dependencies);
+    readDependencies(n, dependencies);
+    writeDependencies(result, dependencies);
+
+    // Padding takes part in the products, so it must be 0
+    if (paddedSize != size)
+    {
+	packed.resize(2u);
+	cmdQueue.enqueueFillBuffer<FloatType>(packedM, FloatType(), 0u, paddedSize * paddedSize * sizeof(FloatType), &dependencies, &packed[0]);
+	cmdQueue.enqueueFillBuffer<FloatType>(packedN, FloatType(), 0u, paddedSize * paddedSize * sizeof(FloatType), &dependencies, &packed[1]);
+	dependencies = packed;
+    }
+
+    // Leaf block (i, j) goes to leaf position quadrant_index(i, j), with lines of leafSize elements
+    for (cl::size_type i = 0u; i < leafCount; i++)
+	for (cl::size_type j = 0u; j < leafCount; j++)
+	{
+	    cl::size_type const lines = min(leafSize, size - i * leafSize), cols = min(leafSize, size - j * leafSize), leafLine = quadrant_index(i, j) * leafSize;
+
+	    packed.resize(packed.size() + 2u);
+
+	    cmdQueue.enqueueCopyBufferRect
+		(
+		    m, packedM, { j * leafPitch, i * leafSize, 0u }, { 0u, leafLine, 0u }, { cols * sizeof(FloatType), lines, 1u },
+		    size * sizeof(FloatType), 0u, leafPitch, 0u, &dependencies, &packed[packed.size() - 2u]
+		);
+
+	    cmdQueue.enqueueCopyBufferRect
+		(
+		    n, packedN, { j * leafPitch, i * leafSize, 0u }, { 0u, leafLine, 0u }, { cols * sizeof(FloatType), lines, 1u },
+		    size * sizeof(FloatType), 0u, leafPitch, 0u, &dependencies, &packed.back()
+		);
+	}
+
+    StrassenRecursion<FloatType> recursion(kernels<FloatType>(), cmdQueue, leafSize, packed);
+
+    recursion.multiply({ &packedM, 0u }, { &packedN, 0u }, { &packedResult, 0u }, paddedSize, { &work, 0u });
+
+    vector<Event> unpacked;
+
+    for (cl::size_type i = 0u; i < leafCount; i++)
+	for (cl::size_type j = 0u; j < leafCount; j++)
+	{
+	    cl::size_type const lines = min(leafSize, size - i * leafSize), cols = min(leafSize, size - j * leafSize), leafLine = quadrant_index(i, j) * leafSize;
+
+	    unpacked.emplace_back();
+	    cmdQueue.enqueueCopyBufferRect
+		(
+		    packedResult, result, { 0u, leafLine, 0u }, { j * leafPitch, i * leafSize, 0u }, { cols * sizeof(FloatType), lines, 1u },
+		    leafPitch, 0u, size * sizeof(FloatType), 0u, &recursion.lastEvent(), &unpacked.back()
+		);
+	}
+
+    Event event;
+
+    cmdQueue.enqueueMarkerWithWaitList(&unpacked, &event);
+    cmdQueue.flush();
+
+    readEvent(m, event);
+    readEvent(n, event);
+    writeEvent(result, event);
+
+    return event;
+}
+
+template bool MatrixStrassen::fits<cl_float>(cl::size_type size, unsigned bufferCount);
+template bool MatrixStrassen::fits<cl_double>(cl::size_type size, unsigned bufferCount);
+
+template cl::size_type MatrixStrassen::tuneCrossover<cl_float>();
+template cl::size_type MatrixStrassen::tuneCrossover<cl_double>();
+
+template cl::Event MatrixStrassen::multiply_strassen<cl_float>(cl::Buffer const &m, cl::Buffer const &n, cl::Buffer &result, cl::size_type size, cl::size_type crossover);
+template cl::Event MatrixStrassen::multiply_strassen<cl_double>(cl::Buffer const &m, cl::Buffer const &n, cl::Buffer &result, cl::size_type size, cl::size_type crossover);
@@ -0,0 +1,93 @@
+#if !defined(CL_MATRIX_STRASSEN_HH)
+#define CL_MATRIX_STRASSEN_HH
+
+#include <map>
+#include <string>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "cl-matrix-mult.hh"
+
+// Strassen-Winograd multiplication of square matrices in device buffers: 7 multiplications and 15 sums of
+// quadrants for each level of recursion, down to a crossover size below which the direct tiled kernel is
+// faster. The operands are first copied to a recursive (quadrant-major) layout, where each quadrant at each
+// level is contiguous, so quadrants are sub-buffers (cl::Buffer::createSubBuffer) of the copies, and are
+// never copied again. Sub-buffers of the same memory are distinct buffers to the dependency tracking in
+// Matrix, so the commands of one multiplication run one after the other.
+class MatrixStrassen: public Matrix
+{
+    protected:
+	std::map<std::string, cl::size_type> crossovers;
+
+	template<typename FloatType>
+	    cl::size_type tuneCrossover();
+
+    public:
+	MatrixStrassen(cl::Context &context, cl_uint vectorWidth = 0u, cl_command_queue_properties queueProperties = 0u);
+
+	// Size above which one more level of recursion pays, tuned for the device on first use for each type, or 0
+	// if it could not be tuned, for the direct kernel only
+	template<typename FloatType>
+	    cl::size_type crossover();
+
+	template<typename FloatType>
+	    void setCrossover(cl::size_type size);
+
+	// Levels of recursion for the given matrix size: halving the size until it is no larger than crossover
+	static unsigned recursionDepth(cl::size_type size, cl::size_type crossover);
+
+	// bufferCount size x size matrices fit the device, next to the copies and the temporary quadrants
+	// used by multiply_strassen()
+	template<typename FloatType>
+	    bool fits(cl::size_type size, unsigned bufferCount);
+
+	// result = m * n, for dense, row-major size x size matrices, with the given crossover size, or with
+	// the tuned crossover if 0. Returns the event for the completed result.
+	template<typename FloatType>
+	    cl::Event multiply_strassen(cl::Buffer const &m, cl::Buffer const &n, cl::Buffer &result, cl::size_type size, cl::size_type crossover = 0u);
+};
+
+// Position of block (line, col) in the recursive layout, in blocks: the bits of line and col interleaved,
+// so the quadrants of every level come in the order 11, 12, 21, 22
+inline cl::size_type quadrant_index(cl::size_type line, cl::size_type col)
+{
+    cl::size_type index = 0u;
+
+    for (unsigned bit = 0u; (line | col) >> bit; bit++)
+	index |= ((line >> bit & 1u) << (2u * bit + 1u)) | ((col >> bit & 1u) << (2u * bit));
+
+    return index;
+}
+
+template<typename FloatType>
+    inline cl::size_type MatrixStrassen::crossover()
+{
+    auto it = crossovers.find(MatrixKernels<FloatType>::typeName());
+
+    if (it == crossovers.end())
+	it = crossovers.emplace(MatrixKernels<FloatType>::typeName(), tuneCrossover<FloatType>()).first;
+
+    return it->second;
+}
+
+template<typename FloatType>
+    inline void MatrixStrassen::setCrossover(cl::size_type size)
+{
+    crossovers[MatrixKernels<FloatType>::typeName()] = size;
+}
+
+inline unsigned MatrixStrassen::recursionDepth(cl::size_type size, cl::size_type crossover)
+{
+    unsigned depth = 0u;
+
+    while (crossover && (size + (cl::size_type(1u) << depth) - 1u) >> depth > crossover)
+	depth++;
+
+    return depth;
+}
+
+#endif // !defined(CL_MATRIX_STRASSEN_HH)
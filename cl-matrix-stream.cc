@@ -0,0 +1,226 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "cl-matrix-mult.hh"
+#include "cl-matrix-stream.hh"
+
+using std::min;
+using std::vector;
+
+using cl::Context;
+using cl::Buffer;
+using cl::Event;
+using cl::EnqueueArgs;
+
+MatrixStream::MatrixStream(Context &context, cl_uint vectorWidth, cl_command_queue_properties queueProperties)
+    : Matrix(context, vectorWidth, queueProperties),
+      uploadQueue(::clCreateCommandQueue(context(), device(), queueProperties, nullptr), true),
+      readQueue(::clCreateCommandQueue(context(), device(), queueProperties, nullptr), true)
+{
+}
+
+template<typename FloatType>
+    cl::size_type MatrixStream::blockSize(cl::size_type maxBlockSize)
+{
+    GemmConfig const &config = gemmConfig<FloatType>();
+    cl::size_type const
+	maxAllocSize = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>(),
+	bufferSize = min<cl::size_type>(maxAllocSize, device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 2u / 6u);
+
+    cl::size_type size = static_cast<cl::size_type>(std::sqrt(static_cast<double>(bufferSize / sizeof(FloatType))));
+
+    if (maxBlockSize)
+	size = min(size, maxBlockSize);
+
+    size = size / config.tileSize * config.tileSize;
+
+    if (!size)
+	throw std::runtime_error("Device memory is too small for one matrix multiplication tile");
+
+    return size;
+}
+
+template<typename FloatType>
+    void MatrixStream::multiply_streamed
+	(
+	    FloatType const *m, cl::size_type m_stride, FloatType const *n, cl::size_type n_stride, FloatType *result, cl::size_type result_stride,
+	    cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type maxBlockSize
+	)
+{
+    multiply_regions(m, m_stride, n, n_stride, result, result_stride, inner, vector<MatrixRegion>(1u, MatrixRegion { 0u, 0u, lines, cols }), maxBlockSize);
+}
+
+// Each region is split into result blocks. For each result block, multiply the (ib, kb) and (kb, jb) panels
+// for all kb, accumulating into the result block, that the first multiply (with beta 0) overwrites. Panels
+// and result blocks alternate between two buffer slots:
+//	- uploads of a panel pair on the upload queue wait for the multiply that used the slot before
+//	- the multiply on the compute queue waits for the upload to its slot, and for the previous multiply
+//	  of the result block, or for the read of the previous block in the result slot
+//	- the result block is read back on the read queue after its last multiply
+// so the transfers of the next panels, and the read of the previous result block, run during the
+// multiply of the current panels.
+//
+// When the m panels of a whole line of blocks fit in the memory budget of blockSize(), they are kept on the
+// device instead, in two slots of line panels. Only the first block of a line of blocks uploads them, after
+// the multiplies of the blocks that last used the slot, and the next blocks on the same lines only upload
+// their n panels.
+template<typename FloatType>
+    void MatrixStream::multiply_regions
+	(
+	    FloatType const *m, cl::size_type m_stride, FloatType const *n, cl::size_type n_stride, FloatType *result, cl::size_type result_stride,
+	    cl::size_type inner, vector<MatrixRegion> const &regions, cl::size_type maxBlockSize
+	)
+{
+    MatrixKernels<FloatType> &kernels = this->kernels<FloatType>();
+    cl::size_type const
+	block = blockSize<FloatType>(maxBlockSize), blockBytes = block * block * sizeof(FloatType),
+	panelCount = (inner + block - 1u) / block;
+    bool const keepLines = (2u * panelCount + 4u) * blockBytes <= device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 2u;
+
+    vector<Buffer> mPanels[2];
+    Buffer
+	nPanels[2] =
+	{
+	    Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY, blockBytes),
+	    Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY, blockBytes)
+	},
+	resultBlocks[2] =
+	{
+	    Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY, blockBytes),
+	    Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY, blockBytes)
+	};
+
+    for (auto &slotPanels: mPanels)
+	for (cl::size_type panel = 0u; panel < (keepLines ? panelCount : 1u); panel++)
+	    slotPanels.emplace_back(context, CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY, blockBytes);
+
+    vector<Event> multiplyDone[2], readDone[2], lineUploads[2], lineUsers[2];
+    unsigned panelSlot = 0u, resultSlot = 0u, lineSlot = 1u;
+    cl::size_type lineStart = 0u, lineCount = 0u;
+
+    for (auto const &region: regions)
+	for (cl::size_type ib = region.line; ib < region.line + region.lines; ib += block)
+	    for (cl::size_type jb = region.col; jb < region.col + region.cols; jb += block)
+	    {
+		cl::size_type const blockLines = min(block, region.line + region.lines - ib), blockCols = min(block, region.col + region.cols - jb);
+		bool const uploadLine = !keepLines || ib != lineStart || blockLines != lineCount;
+		Event lastMultiply;
+
+		if (keepLines && uploadLine)
+		{
+		    lineSlot ^= 1u;
+		    lineStart = ib;
+		    lineCount = blockLines;
+		    lineUploads[lineSlot].assign(panelCount, Event());
+		}
+
+		for (cl::size_type kb = 0u; kb < inner; kb += block)
+		{
+		    cl::size_type const blockInner = min(block, inner - kb);
+		    Buffer &mPanel = keepLines ? mPanels[lineSlot][kb / block] : mPanels[panelSlot][0];
+		    vector<Event> uploaded(1u);
+
+		    if (uploadLine)
+		    {
+			uploadQueue.enqueueWriteBufferRect
+			    (
+				mPanel, CL_FALSE, { 0u, 0u, 0u }, { kb * sizeof(FloatType), ib, 0u }, { blockInner * sizeof(FloatType), blockLines, 1u },
+				blockInner * sizeof(FloatType), 0u, m_stride * sizeof(FloatType), 0u, m, keepLines ? &lineUsers[lineSlot] : &multiplyDone[panelSlot],
+				&uploaded[0]
+			    );
+
+			if (keepLines)
+			    lineUploads[lineSlot][kb / block] = uploaded[0];
+		    }
+		    else
+			uploaded[0] = lineUploads[lineSlot][kb / block];
+
+		    uploaded.emplace_back();
+		    uploadQueue.enqueueWriteBufferRect
+			(
+			    nPanels[panelSlot], CL_FALSE, { 0u, 0u, 0u }, { jb * sizeof(FloatType), kb, 0u }, { blockCols * sizeof(FloatType), blockInner, 1u },
+			    blockCols * sizeof(FloatType), 0u, n_stride * sizeof(FloatType), 0u, n, &multiplyDone[panelSlot], &uploaded[1]
+			);
+
+		    uploadQueue.flush();
+
+		    // The compute queue may run out of order, so each multiply also waits for the previous one on the
+		    // same result block
+		    if (kb)
+			uploaded.push_back(lastMultiply);
+		    else
+			uploaded.insert(uploaded.end(), readDone[resultSlot].begin(), readDone[resultSlot].end());
+
+		    lastMultiply = kernels.multiply_matrix_tile
+			(
+			    EnqueueArgs(cmdQueue, uploaded, kernels.globalSize(blockLines, blockCols), kernels.localSize()),
+			    mPanel, false, nPanels[panelSlot], false, resultBlocks[resultSlot], blockLines, blockInner, blockCols, 1, kb ? 1 : 0
+			);
+
+		    cmdQueue.flush();
+
+		    multiplyDone[panelSlot].assign(1u, lastMultiply);
+		    panelSlot ^= 1u;
+		}
+
+		// The multiplies of each result block run in order, so the last one stands for all of them
+		if (keepLines)
+		{
+		    if (uploadLine)
+			lineUsers[lineSlot].clear();
+
+		    lineUsers[lineSlot].push_back(lastMultiply);
+		}
+
+		vector<Event> multiplied(1u, lastMultiply);
+
+		readDone[resultSlot].resize(1u);
+		readQueue.enqueueReadBufferRect
+		    (
+			resultBlocks[resultSlot], CL_FALSE, { 0u, 0u, 0u }, { jb * sizeof(FloatType), ib, 0u }, { blockCols * sizeof(FloatType), blockLines, 1u },
+			blockCols * sizeof(FloatType), 0u, result_stride * sizeof(FloatType), 0u, result, &multiplied, &readDone[resultSlot][0]
+		    );
+
+		readQueue.flush();
+		resultSlot ^= 1u;
+	    }
+
+    cmdQueue.finish();
+    uploadQueue.finish();
+    readQueue.finish();
+}
+
+template cl::size_type MatrixStream::blockSize<cl_float>(cl::size_type maxBlockSize);
+template cl::size_type MatrixStream::blockSize<cl_double>(cl::size_type maxBlockSize);
+
+template void MatrixStream::multiply_streamed<cl_float>
+    (
+	cl_float const *m, cl::size_type m_stride, cl_float const *n, cl::size_type n_stride, cl_float *result, cl::size_type result_stride,
+	cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type maxBlockSize
+    );
+
+template void MatrixStream::multiply_streamed<cl_double>
+    (
+	cl_double const *m, cl::size_type m_stride, cl_double const *n, cl::size_type n_stride, cl_double *result, cl::size_type result_stride,
+	cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type maxBlockSize
+    );
+
+template void MatrixStream::multiply_regions<cl_float>
+    (
+	cl_float const *m, cl::size_type m_stride, cl_float const *n, cl::size_type n_stride, cl_float *result, cl::size_type result_stride,
+	cl::size_type inner, vector<MatrixRegion> const &regions, cl::size_type maxBlockSize
+    );
+
+template void MatrixStream::multiply_regions<cl_double>
+    (
+	cl_double const *m, cl::size_type m_stride, cl_double const *n, cl::size_type n_stride, cl_double *result, cl::size_type result_stride,
+	cl::size_type inner, vector<MatrixRegion> const &regions, cl::size_type maxBlockSize
+    );
@@ -0,0 +1,69 @@
+#if !defined(CL_MATRIX_STREAM_HH)
+#define CL_MATRIX_STREAM_HH
+
+#include <vector>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "cl-matrix-mult.hh"
+
+// Rectangular region of a matrix, by its first line and column and its size
+struct MatrixRegion
+{
+    cl::size_type line, col, lines, cols;
+};
+
+// Out-of-core multiplication of host matrices that need not fit in one device buffer, or in the device
+// memory. The result is computed one block at a time, from block panels of the operands that are
+// uploaded on a separate queue, double buffered, while the previous panels are multiplied. Result
+// blocks are read back on a third queue.
+class MatrixStream: public Matrix
+{
+    protected:
+	cl::CommandQueue uploadQueue, readQueue;
+
+    public:
+	MatrixStream(cl::Context &context, cl_uint vectorWidth = 0u, cl_command_queue_properties queueProperties = 0u);
+
+	// Largest block size (lines and columns of a square block) for which the 6 device buffers (2 for each of
+	// the m, n and result blocks) fit the max allocation size and half of the global memory, as a multiple
+	// of the kernel tile size, and no larger than maxBlockSize (if given)
+	template<typename FloatType>
+	    cl::size_type blockSize(cl::size_type maxBlockSize = 0u);
+
+	// result = m * n, for row-major host matrices m (lines x inner), n (inner x cols) and result
+	// (lines x cols). Returns after the result has been read back.
+	template<typename FloatType>
+	    void multiply_streamed(FloatType const *m, FloatType const *n, FloatType *result, cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type maxBlockSize = 0u);
+
+	// Same, for sub-matrices of larger host matrices, with the given line lengths (strides)
+	template<typename FloatType>
+	    void multiply_streamed
+		(
+		    FloatType const *m, cl::size_type m_stride, FloatType const *n, cl::size_type n_stride, FloatType *result, cl::size_type result_stride,
+		    cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type maxBlockSize = 0u
+		);
+
+	// Same, for the given regions of the result only, in the given order, all through the same device
+	// buffers, so the transfers for the next region run during the multiply of the current one. Consecutive
+	// blocks on the same lines of the result share the m panels uploaded for the first of them, when the
+	// panels for a whole line of blocks fit in the device memory.
+	template<typename FloatType>
+	    void multiply_regions
+		(
+		    FloatType const *m, cl::size_type m_stride, FloatType const *n, cl::size_type n_stride, FloatType *result, cl::size_type result_stride,
+		    cl::size_type inner, std::vector<MatrixRegion> const &regions, cl::size_type maxBlockSize = 0u
+		);
+};
+
+template<typename FloatType>
+    inline void MatrixStream::multiply_streamed(FloatType const *m, FloatType const *n, FloatType *result, cl::size_type lines, cl::size_type inner, cl::size_type cols, cl::size_type maxBlockSize)
+{
+    multiply_streamed(m, inner, n, cols, result, cols, lines, inner, cols, maxBlockSize);
+}
+
+#endif // !defined(CL_MATRIX_STREAM_HH)
@@ -1,9 +1,15 @@
 #include <cstddef>
+#include <cmath>
 #include <chrono>
 #include <thread>
 #include <iterator>
 #include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <limits>
 #include <memory>
+#include <vector>
+#include <string>
 
 #if defined(__APPLE__) || defined(__MACOSX__)
 # include <OpenCL/cl2.hpp>
@@ -12,26 +18,66 @@
 #endif
 
 #include "cl-platform-info.hh"
+#include "cl-matrix-mult.hh"
+#include "cl-matrix-stream.hh"
+#include "cl-matrix-multi.hh"
+#include "cl-matrix-strassen.hh"
+#include "host-matrix-mult.hh"
+#include "timing-stats.hh"
 #include "cl-double-pendulum.hh"
+#include "cl-gemm-tuner.hh"
+#include "cl-build-variants.hh"
 #include "cl-platform-probe.hh"
 
 using std::size_t;
 using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::duration;
+using std::chrono::steady_clock;
 using std::cout;
 using std::clog;
 using std::endl;
 using std::flush;
 using std::size;
-using std::unique_ptr;
+using std::min;
+using std::max;
+using std::max_element;
+using std::find_if;
+using std::nth_element;
+using std::setw;
+using std::setprecision;
+using std::fixed;
+using std::vector;
+using std::string;
+using std::numeric_limits;
 
 using cl::Platform;
 using cl::Device;
+using cl::Context;
+using cl::Buffer;
+using cl::Event;
 using cl::NDRange;
 
 static const auto
     SIMULATION_STEP_PROBE_TIME = milliseconds(75),
     SIMULATION_PROBE_TIME_MAX  = milliseconds(450);	    // Allow for at least 3 full time steps during probe
 
+// Simulations for each work item count are repeated until the 95% confidence interval for the median time
+// is within 2% of the median, see time_simulation()
+static double const SIMULATION_INTERVAL_TARGET = 0.02;
+static unsigned const SIMULATION_MAX_RUNS = 32u;
+
+static cl::size_type const
+    GEMM_PROBE_MIN_SIZE = 128u,
+    GEMM_PROBE_MAX_SIZE = 8192u,
+    GEMM_VERIFY_TILE_SIZE = 32u,
+    HOST_GEMM_MAX_SIZE = 2048u,	    // Larger sizes only verify sampled tiles, with no host speed
+    NAIVE_GEMM_MAX_SIZE = 2048u,    // Larger sizes take too long with the naive kernel, with no naive speed
+    GEMM_BATCH_COUNT = 65536u,	    // Products in one batch, if they fit in the device memory
+    MULTI_DEVICE_GEMM_SIZE = 8192u,
+    STRASSEN_PROBE_MIN_SIZE = 1024u,
+    MULTI_DEVICE_GEMM_BLOCK_SIZE = 1024u;
+
 extern void probe_cl_platform(Platform &platform)
 {
     cout << trim_name(platform.getInfo<CL_PLATFORM_NAME>()) << endl;
@@ -43,11 +89,11 @@ static size_t probe_global_simulation_size(DoublePendulumSimulation &sim, size_t
 
     while
 	(
-	    milliseconds(sim.runSimulation(NDRange((base_size + n)     * size_multiple), NDRange(size_multiple))) < SIMULATION_PROBE_TIME_MAX
+	    nanoseconds(sim.runSimulation(NDRange((base_size + n)     * size_multiple), NDRange(size_multiple))) < SIMULATION_PROBE_TIME_MAX
 		||
-	    milliseconds(sim.runSimulation(NDRange((base_size + n + 1) * size_multiple), NDRange(size_multiple))) < SIMULATION_PROBE_TIME_MAX
+	    nanoseconds(sim.runSimulation(NDRange((base_size + n + 1) * size_multiple), NDRange(size_multiple))) < SIMULATION_PROBE_TIME_MAX
 		||
-	    milliseconds(sim.runSimulation(NDRange((base_size + n + 2) * size_multiple), NDRange(size_multiple))) < SIMULATION_PROBE_TIME_MAX
+	    nanoseconds(sim.runSimulation(NDRange((base_size + n + 2) * size_multiple), NDRange(size_multiple))) < SIMULATION_PROBE_TIME_MAX
 	)
     {
 	n *= 2u;
@@ -59,41 +105,989 @@ static size_t probe_global_simulation_size(DoublePendulumSimulation &sim, size_t
     return base_size;
 }
 
-static void show_simulation_times(Device &device, size_t simulation_size, size_t size_multiple, size_t step_size, unsigned long const times[], unsigned int pass_count)
+// Run the simulation until there are min_count times, and then until the confidence interval of the median
+// time is narrower than SIMULATION_INTERVAL_TARGET relative to the median, or than two ticks of the profiling
+// timer, which is as narrow as the timer can tell, with at most SIMULATION_MAX_RUNS times.
+static TimingStats time_simulation(DoublePendulumSimulation &sim, size_t item_count, size_t size_multiple, size_t timer_resolution, unsigned min_count, vector<cl_ulong> &times)
 {
-#if !defined(DISABLE_LOGGING)
+    while (times.size() < min_count)
+	times.push_back(sim.runSimulation(NDRange(item_count), NDRange(size_multiple)));
 
-    cout << '\n';
+    TimingStats stats = timing_stats(times);
+
+    while
+	(
+	    times.size() < max(min_count, SIMULATION_MAX_RUNS)
+		&&
+	    !stats.isNarrow(SIMULATION_INTERVAL_TARGET, timer_resolution)
+	)
+    {
+	times.push_back(sim.runSimulation(NDRange(item_count), NDRange(size_multiple)));
+	stats = timing_stats(times);
+    }
+
+    return stats;
+}
+
+// Pendulum steps per second for a simulation of item_count work items that ran in time_ns
+static double simulation_step_rate(DoublePendulumSimulation const &sim, size_t item_count, double time_ns)
+{
+    return time_ns > 0.0 ? 1.0e9 * item_count * sim.pendulumsPerItem() * sim.iterationCount() / time_ns : 0.0;
+}
+
+static double simulation_gflops(DoublePendulumSimulation const &sim, size_t item_count, double time_ns)
+{
+    return simulation_step_rate(sim, item_count, time_ns) * DoublePendulumSimulation::stepFlopCount / 1.0e9;
+}
+
+// Show the speed of each simulation in GFLOPS for each pass, the time statistics for each work item count, and
+// the peak and plateau speeds, from the median time for each work item count. The plateau is the median speed
+// for the work item counts from the first one that reaches 90% of the peak, where the device is saturated.
+static void show_simulation_times
+    (
+	Device &device, DoublePendulumSimulation const &sim, size_t simulation_size, size_t size_multiple, size_t step_size,
+	vector<vector<cl_ulong>> const &times, vector<TimingStats> const &stats, unsigned int pass_count
+    )
+{
+    vector<double> medianRates(simulation_size);
 
-    cout << "counts = [ 0";
     for (size_t n = 1u; n <= simulation_size; n++)
-	cout << ", " << n * step_size * size_multiple;
-    cout << " ]" << endl;
+	medianRates[n - 1u] = simulation_step_rate(sim, n * step_size * size_multiple, stats[n - 1u].median);
 
-    for (unsigned pass = 0; pass < pass_count; pass++)
+#if !defined(DISABLE_LOGGING)
+
+    auto const show_values = [&](char const *name, auto value)
     {
-	cout << "times_" << pass << " = [ 0";
-	for (unsigned n = 1u; n <= simulation_size; n++)
-	    cout << ", " << times[(n - 1u) * pass_count + pass];
+	cout << name << " = [ 0";
+	for (size_t n = 1u; n <= simulation_size; n++)
+	    cout << ", " << value(n);
 	cout << " ]" << endl;
+    };
+
+    auto const show_figure = [&](char const *plot)
+    {
 	cout << "figure" << endl;
-	cout << "plot(counts, times_" << pass <<", '.')" << endl;
+	cout << plot << endl;
 	cout << "title(\"" << trim_name(device.getInfo<CL_DEVICE_VENDOR>()) << " - "
 	     << trim_name(Platform(device.getInfo<CL_DEVICE_PLATFORM>()).getInfo<CL_PLATFORM_NAME>()) << "\\n"
 	     << trim_name(device.getInfo<CL_DEVICE_NAME>()) << "\\n"
 	     << trim_name(device.getInfo<CL_DEVICE_VERSION>()) << "\")" << endl;
 	cout << "xlabel('Work group size (work items count)')" << endl;
-	cout << "ylabel('Simulation time (ms)')" << endl;
+	cout << "ylabel('Simulation speed (GFLOPS)')" << endl;
 	cout << "grid on" << endl;
 	cout << "grid minor on" << endl;
 	cout << endl;
+    };
+
+    cout << '\n' << fixed << setprecision(3);
+
+    show_values("counts", [&](size_t n) { return n * step_size * size_multiple; });
+
+    for (unsigned pass = 0; pass < pass_count; pass++)
+    {
+	string const name = "gflops_" + std::to_string(pass);
+
+	show_values(name.c_str(), [&](size_t n) { return simulation_gflops(sim, n * step_size * size_multiple, times[n - 1u][pass]); });
+	show_figure(("plot(counts, " + name + ", '.')").c_str());
     }
 
+    show_values("runs", [&](size_t n) { return stats[n - 1u].count; });
+    show_values("median_ns", [&](size_t n) { return stats[n - 1u].median; });
+    show_values("mad_ns", [&](size_t n) { return stats[n - 1u].mad; });
+    show_values("p5_ns", [&](size_t n) { return stats[n - 1u].p5; });
+    show_values("p95_ns", [&](size_t n) { return stats[n - 1u].p95; });
+    show_values("ci_low_ns", [&](size_t n) { return stats[n - 1u].ciLow; });
+    show_values("ci_high_ns", [&](size_t n) { return stats[n - 1u].ciHigh; });
+
+    // The longer time of the interval gives the lower speed
+    show_values("gflops_median", [&](size_t n) { return simulation_gflops(sim, n * step_size * size_multiple, stats[n - 1u].median); });
+    show_values("gflops_low", [&](size_t n) { return simulation_gflops(sim, n * step_size * size_multiple, stats[n - 1u].ciHigh); });
+    show_values("gflops_high", [&](size_t n) { return simulation_gflops(sim, n * step_size * size_multiple, stats[n - 1u].ciLow); });
+    show_figure("errorbar(counts, gflops_median, gflops_median - gflops_low, gflops_high - gflops_median, '.')");
+
 #endif
+
+    if (medianRates.empty())
+	return;
+
+    size_t const peak = max_element(medianRates.begin(), medianRates.end()) - medianRates.begin();
+    size_t const plateau = find_if(medianRates.begin(), medianRates.end(), [&](double rate) { return rate >= 0.9 * medianRates[peak]; }) - medianRates.begin();
+    vector<double> plateauRates(medianRates.begin() + plateau, medianRates.end());
+
+    nth_element(plateauRates.begin(), plateauRates.begin() + plateauRates.size() / 2u, plateauRates.end());
+
+    double const plateauRate = plateauRates[plateauRates.size() / 2u];
+
+    cout << "\tPeak speed:            " << fixed << setprecision(2) << medianRates[peak] * DoublePendulumSimulation::stepFlopCount / 1.0e9 << " GFLOPS, "
+	 << setprecision(3) << medianRates[peak] / 1.0e9 << " G steps/s, for " << (peak + 1u) * step_size * size_multiple << " work items, "
+	 << setprecision(1) << 100.0 * stats[peak].relativeInterval() << "% confidence interval" << endl;
+    cout << "\tPlateau speed:         " << fixed << setprecision(2) << plateauRate * DoublePendulumSimulation::stepFlopCount / 1.0e9 << " GFLOPS, "
+	 << setprecision(3) << plateauRate / 1.0e9 << " G steps/s, from " << (plateau + 1u) * step_size * size_multiple << " work items" << endl;
+}
+
+// Simulation speed in pendulum steps per second, from the median time of at least pass_count runs, see
+// time_simulation(). The simulation is sized on its own, like for the default probe, and the line shows the
+// work item count and the step count.
+static double show_simulation_speed(Device &device, DoublePendulumSimulation &sim, unsigned pass_count)
+{
+    sim.probeIterationCount(SIMULATION_STEP_PROBE_TIME);
+
+    size_t const
+	size_multiple = sim.groupSizeMultiple(),
+	item_count = probe_global_simulation_size(sim, 1u, size_multiple) * size_multiple;
+    vector<cl_ulong> times;
+    TimingStats const stats = time_simulation(sim, item_count, size_multiple, device.getInfo<CL_DEVICE_PROFILING_TIMER_RESOLUTION>(), pass_count, times);
+    double const speed = simulation_step_rate(sim, item_count, stats.median);
+
+    cout << setw(8) << item_count << " work items, " << setw(8) << sim.iterationCount() << " steps, "
+	 << fixed << setprecision(3) << setw(10) << speed / 1.0e9 << " G steps/s, "
+	 << setprecision(2) << setw(10) << speed * DoublePendulumSimulation::stepFlopCount / 1.0e9 << " GFLOPS, "
+	 << setprecision(1) << setw(4) << 100.0 * stats.relativeInterval() << "% confidence interval";
+
+    return speed;
+}
+
+// Simulation speed with 1, 2, 4 and 8 pendulums integrated by each work item
+static void probe_item_widths(Device &device, unsigned pass_count)
+{
+    static unsigned const itemWidths[] = { 1u, 2u, 4u, 8u };
+    double baseSpeed = 0.0;
+
+    cout << "\tPendulums per work item:" << endl;
+
+    for (unsigned itemWidth: itemWidths)
+	try
+	{
+	    cout << "\t    " << itemWidth << ": ";
+
+	    double const speed = show_simulation_speed(device, DoublePendulumSimulation::get(device, itemWidth), pass_count);
+
+	    if (itemWidth == 1u)
+		baseSpeed = speed;
+
+	    if (baseSpeed)
+		cout << ", speedup " << setprecision(2) << speed / baseSpeed << 'x';
+
+	    cout << endl;
+	}
+	catch (cl::Error const &error)
+	{
+	    cout << "OpenCL error " << error_string(error.err()) << " in call to function " << error.what() << "()" << endl;
+	}
+}
+
+// Simulation speed in half, float and double, for the precisions the device supports, with the speed ratio
+// to float (the fp64:fp32 ratio for double)
+static void probe_precisions(Device &device, unsigned pass_count)
+{
+    static SimulationPrecision const precisions[] = { SimulationPrecision::Single, SimulationPrecision::Double, SimulationPrecision::Half };
+    double floatSpeed = 0.0;
+
+    cout << "\tSimulation precision:" << endl;
+
+    for (SimulationPrecision precision: precisions)
+    {
+	cout << "\t    " << setw(6) << simulationPrecisionName(precision) << ": ";
+
+	if (!DoublePendulumSimulation::hasPrecision(device, precision))
+	{
+	    cout << "not supported" << endl;
+	    continue;
+	}
+
+	try
+	{
+	    double const speed = show_simulation_speed(device, DoublePendulumSimulation::get(device, 1u, precision), pass_count);
+
+	    if (precision == SimulationPrecision::Single)
+		floatSpeed = speed;
+	    else
+		if (floatSpeed)
+		    cout << ", " << setprecision(3) << speed / floatSpeed << "x float";
+
+	    // The time step updates are rounded away in half, see STATE_TYPE in cl-double-pendulum.cl
+	    if (precision == SimulationPrecision::Half)
+		cout << ", state accumulated in float";
+
+	    cout << endl;
+	}
+	catch (cl::Error const &error)
+	{
+	    cout << "OpenCL error " << error_string(error.err()) << " in call to function " << error.what() << "()" << endl;
+	}
+    }
+}
+
+// Check sampled tiles of the device result against the host multiplication of the operands read back
+// from the device, and time the full host multiplication for sizes up to HOST_GEMM_MAX_SIZE
+template<typename FloatType>
+    static bool verify_gemm(Matrix &mat, Buffer const &m, Buffer const &n, Buffer const &result, cl::size_type size, double &hostSpeed)
+{
+    cl::size_type const
+	tileSize = std::min(size, GEMM_VERIFY_TILE_SIZE),
+	tilePositions[][2] = { { 0u, 0u }, { 0u, size - tileSize }, { size / 2u, size / 3u }, { size - tileSize, 0u }, { size - tileSize, size - tileSize } };
+
+    double const tolerance = size * numeric_limits<FloatType>::epsilon();
+    vector<FloatType> deviceTile, hostTile(tileSize * tileSize);
+    double maxError = 0.0;
+
+    // The operands are only mapped, with no copy on unified memory devices
+    MatrixView<FloatType> const hostM = mat.mapBufferRect<FloatType>(m, size, size, 0u, 0u, size, size), hostN = mat.mapBufferRect<FloatType>(n, size, size, 0u, 0u, size, size);
+
+    for (auto const &position: tilePositions)
+    {
+	mat.readBufferRect<FloatType>(result, size, size, position[0], position[1], tileSize, tileSize, deviceTile);
+	host_multiply(tileSize, tileSize, size, &hostM(position[0], 0u), size, &hostN(0u, position[1]), size, hostTile.data(), tileSize);
+	maxError = std::max(maxError, relative_error(deviceTile.data(), hostTile.data(), hostTile.size()));
+    }
+
+    hostSpeed = 0.0;
+
+    if (size <= HOST_GEMM_MAX_SIZE)
+    {
+	vector<FloatType> hostResult(size * size);
+	auto const startTime = steady_clock::now();
+
+	host_multiply(size, size, size, hostM.data(), size, hostN.data(), size, hostResult.data(), size);
+	hostSpeed = 2.0 * size * size * size / duration<double, std::nano>(steady_clock::now() - startTime).count();
+    }
+
+    if (maxError > tolerance)
+    {
+	clog << "	    Verification FAILED for " << size << 'x' << size << ": relative error " << std::scientific << setprecision(3) << maxError
+	     << " over tolerance " << tolerance << std::defaultfloat << endl;
+
+	return false;
+    }
+
+    return true;
+}
+
+// Check sampled tiles of the gemm() results with the stored m, n or both transposed, against the host
+// product of the transposed operands, so --verify also covers the transposed indexing of the kernel.
+// The result buffer is left with the last product.
+template<typename FloatType>
+    static bool verify_gemm_transposed(Matrix &mat, Buffer const &m, Buffer const &n, Buffer &result, cl::size_type size)
+{
+    static bool const transposeFlags[][2] = { { true, false }, { false, true }, { true, true } };
+    cl::size_type const
+	tileSize = std::min(size, GEMM_VERIFY_TILE_SIZE),
+	tilePositions[][2] = { { 0u, 0u }, { size / 2u, size / 3u }, { size - tileSize, size - tileSize } };
+
+    double const tolerance = size * numeric_limits<FloatType>::epsilon();
+    vector<FloatType> deviceTile, hostTile(tileSize * tileSize), mPanel(tileSize * size), nPanel(size * tileSize);
+    MatrixView<FloatType> const hostM = mat.mapBufferRect<FloatType>(m, size, size, 0u, 0u, size, size), hostN = mat.mapBufferRect<FloatType>(n, size, size, 0u, 0u, size, size);
+
+    for (auto const &flags: transposeFlags)
+    {
+	double maxError = 0.0;
+
+	mat.gemm<FloatType>(flags[0], flags[1], size, size, size, 1, m, n, 0, result);
+	mat.waitForCompletion();
+
+	for (auto const &position: tilePositions)
+	{
+	    // Lines of op(m) and columns of op(n) for the tile
+	    for (cl::size_type i = 0u; i < tileSize; i++)
+		for (cl::size_type k = 0u; k < size; k++)
+		    mPanel[i * size + k] = flags[0] ? hostM(k, position[0] + i) : hostM(position[0] + i, k);
+
+	    for (cl::size_type k = 0u; k < size; k++)
+		for (cl::size_type j = 0u; j < tileSize; j++)
+		    nPanel[k * tileSize + j] = flags[1] ? hostN(position[1] + j, k) : hostN(k, position[1] + j);
+
+	    mat.readBufferRect<FloatType>(result, size, size, position[0], position[1], tileSize, tileSize, deviceTile);
+	    host_multiply(tileSize, tileSize, size, mPanel.data(), size, nPanel.data(), tileSize, hostTile.data(), tileSize);
+	    maxError = std::max(maxError, relative_error(deviceTile.data(), hostTile.data(), hostTile.size()));
+	}
+
+	if (maxError > tolerance)
+	{
+	    clog << "\t    Verification FAILED for " << size << 'x' << size << " with " << (flags[0] ? flags[1] ? "m and n" : "m" : "n")
+		 << " transposed: relative error " << std::scientific << setprecision(3) << maxError << " over tolerance " << tolerance << std::defaultfloat << endl;
+
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+// Speed of the naive kernel (Matrix::multiply_naive(), with no tiling), for the best of pass_count runs after
+// a warm-up run, to compare with the tiled kernel
+template<typename FloatType>
+    static double naive_gemm_speed(Matrix &mat, Buffer const &m, Buffer const &n, Buffer &result, cl::size_type size, unsigned int pass_count)
+{
+    cl_ulong bestTime = 0u;
+
+    mat.multiply_naive<FloatType>(m, size, size, n, size, size, result, size, size);
+    mat.waitForCompletion();
+
+    for (unsigned pass = 0u; pass < pass_count; pass++)
+    {
+	Event event = mat.multiply_naive<FloatType>(m, size, size, n, size, size, result, size, size);
+	mat.waitForCompletion();
+
+	cl_ulong const kernelTime = event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+
+	bestTime = pass ? min(bestTime, kernelTime) : kernelTime;
+    }
+
+    return bestTime ? 2.0 * size * size * size / bestTime : 0.0;
+}
+
+// Multiply square matrices of doubling sizes, while the operands fit in the device memory, and report
+// the best speed out of pass_count runs for each size, timed with the kernel profiling events
+template<typename FloatType>
+    static bool probe_gemm_speed(Device &device, Matrix &mat, char const *typeName, unsigned int pass_count, unsigned delay_ms, bool verify)
+{
+    cl::size_type const
+	maxAllocSize = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>(),
+	globalMemSize = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+
+    double peakSpeed = 0.0;
+    cl::size_type peakSize = 0u;
+    bool verified = true;
+
+    clog << "\tMatrix multiplication (" << typeName << ", vector width " << mat.vectorWidth<FloatType>() << ", tile " << mat.gemmConfig<FloatType>().tileSize << "):" << endl;
+
+    for (cl::size_type size = GEMM_PROBE_MIN_SIZE; size <= GEMM_PROBE_MAX_SIZE; size *= 2u)
+    {
+	cl::size_type const bufferSize = sizeof(FloatType) * size * size;
+
+	if (bufferSize > maxAllocSize || 3u * bufferSize > globalMemSize / 2u)
+	    break;
+
+	Buffer
+	    m = mat.createBuffer<FloatType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY),
+	    n = mat.createBuffer<FloatType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY),
+	    result = mat.createBuffer<FloatType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY);
+
+	mat.random_fill<FloatType>(m, size, size, -100.0f, 100.0f, size, 0u);
+	mat.random_fill<FloatType>(n, size, size, -100.0f, 100.0f, size, 1u);
+	mat.waitForCompletion();
+
+	// Warm-up run, that may include lazy kernel compilation and buffer allocation on the device,
+	// and leaves the product in result, for verification. With beta 0 the result is only written.
+	mat.gemm<FloatType>(false, false, size, size, size, 1, m, n, 0, result);
+	mat.waitForCompletion();
+
+	double hostSpeed = 0.0;
+
+	if (verify)
+	{
+	    verified = verify_gemm<FloatType>(mat, m, n, result, size, hostSpeed) && verified;
+	    verified = verify_gemm_transposed<FloatType>(mat, m, n, result, size) && verified;
+	}
+
+	cl_ulong bestTime = 0u, totalTime = 0u;
+
+	for (unsigned pass = 0u; pass < pass_count; pass++)
+	{
+	    Event event = mat.gemm<FloatType>(false, false, size, size, size, 1, m, n, 0, result);
+	    mat.waitForCompletion();
+
+	    cl_ulong const kernelTime = event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+
+	    bestTime = pass ? min(bestTime, kernelTime) : kernelTime;
+	    totalTime += kernelTime;
+
+	    if (delay_ms)
+		std::this_thread::sleep_for(milliseconds(delay_ms));
+	}
+
+	if (!bestTime)
+	    continue;
+
+	double const
+	    flops = 2.0 * size * size * size,
+	    bestSpeed = flops / bestTime,
+	    averageSpeed = flops * pass_count / totalTime;
+
+	cout << "\t    " << setw(5) << size << 'x' << setw(5) << size << ": " << fixed << setprecision(2)
+	     << setw(10) << bestSpeed << " GFLOPS (average " << averageSpeed << " GFLOPS, " << setprecision(3) << bestTime / 1.0e6 << " ms)";
+
+	if (hostSpeed > 0.0)
+	    cout << ", host " << setprecision(2) << hostSpeed << " GFLOPS";
+
+	if (size <= NAIVE_GEMM_MAX_SIZE)
+	{
+	    double const naiveSpeed = naive_gemm_speed<FloatType>(mat, m, n, result, size, pass_count);
+
+	    if (naiveSpeed > 0.0)
+		cout << ", naive " << setprecision(2) << naiveSpeed << " GFLOPS (tiled speedup " << bestSpeed / naiveSpeed << "x)";
+	}
+
+	cout << endl;
+
+	if (bestSpeed > peakSpeed)
+	{
+	    peakSpeed = bestSpeed;
+	    peakSize = size;
+	}
+    }
+
+    if (peakSize)
+	cout << "\t    Peak: " << fixed << setprecision(2) << peakSpeed << " GFLOPS for " << peakSize << 'x' << peakSize << " " << typeName << " matrices" << endl;
+    else
+	cout << "\t    No matrix size fits in the device memory" << endl;
+
+    return verified;
+}
+
+// Check sampled products of a batch against the host products of the operands read back from the device.
+// With reversed, product b is stored at position batchCount - 1 - b of the result.
+template<typename FloatType>
+    static bool verify_batched_gemm(Matrix &mat, Buffer const &m, Buffer const &n, Buffer const &result, cl::size_type size, cl::size_type batchCount, bool reversed)
+{
+    cl::size_type const samples[] = { 0u, batchCount / 2u, batchCount - 1u };
+    double const tolerance = size * numeric_limits<FloatType>::epsilon();
+    vector<FloatType> hostProduct(size * size);
+    double maxError = 0.0;
+
+    MatrixView<FloatType> const
+	hostM = mat.mapBufferRect<FloatType>(m, batchCount * size, size, 0u, 0u, batchCount * size, size),
+	hostN = mat.mapBufferRect<FloatType>(n, batchCount * size, size, 0u, 0u, batchCount * size, size),
+	hostResult = mat.mapBufferRect<FloatType>(result, batchCount * size, size, 0u, 0u, batchCount * size, size);
+
+    for (cl::size_type b: samples)
+    {
+	cl::size_type const resultIndex = reversed ? batchCount - 1u - b : b;
+
+	host_multiply(size, size, size, &hostM(b * size, 0u), size, &hostN(b * size, 0u), size, hostProduct.data(), size);
+	maxError = max(maxError, relative_error(&hostResult(resultIndex * size, 0u), hostProduct.data(), hostProduct.size()));
+    }
+
+    if (maxError > tolerance)
+    {
+	clog << "\t    Verification FAILED for " << batchCount << " products of " << size << 'x' << size << (reversed ? " with offsets" : "")
+	     << ": relative error " << std::scientific << setprecision(3) << maxError << " over tolerance " << tolerance << std::defaultfloat << endl;
+
+	return false;
+    }
+
+    return true;
 }
 
-extern bool probe_cl_device(Device &device, unsigned int pass_count, unsigned long simulation_count, unsigned delay_ms)
+// Multiply batches of small square matrices with Matrix::multiplyBatched(), with one work item for each
+// product and with one work group for each product, and report the best speed out of pass_count runs for
+// each, with the strategy that BatchStrategy::Auto picks. With verify, sampled products are checked on
+// the host, also for the batch with the element offsets of each product given in a buffer.
+template<typename FloatType>
+    static bool probe_gemm_batched(Device &device, Context &context, Matrix &mat, char const *typeName, unsigned int pass_count, bool verify)
 {
+    static cl::size_type const batchSizes[] = { 4u, 8u, 16u, 32u };
+    static BatchStrategy const strategies[] = { BatchStrategy::ItemPerMatrix, BatchStrategy::GroupPerMatrix };
+
+    cl::size_type const
+	maxAllocSize = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>(),
+	globalMemSize = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+
+    bool verified = true;
+
+    clog << "\tBatched matrix multiplication (" << typeName << "):" << endl;
+
+    for (cl::size_type size: batchSizes)
+    {
+	cl::size_type const
+	    matrixSize = sizeof(FloatType) * size * size,
+	    batchCount = min(GEMM_BATCH_COUNT, min(maxAllocSize, globalMemSize / 2u / 3u) / matrixSize);
+
+	if (!batchCount)
+	    break;
+
+	Buffer
+	    m = mat.createBuffer<FloatType>(batchCount * size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY),
+	    n = mat.createBuffer<FloatType>(batchCount * size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY),
+	    result = mat.createBuffer<FloatType>(batchCount * size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY);
+
+	mat.random_fill<FloatType>(m, batchCount * size, size, -100.0f, 100.0f, size, 0u);
+	mat.random_fill<FloatType>(n, batchCount * size, size, -100.0f, 100.0f, size, 1u);
+	mat.waitForCompletion();
+
+	for (BatchStrategy strategy: strategies)
+	{
+	    // The first run includes building the kernels, and leaves the products for verification
+	    mat.multiplyBatched<FloatType>(m, 0u, n, 0u, result, 0u, size, size, size, batchCount, strategy);
+	    mat.waitForCompletion();
+
+	    if (verify)
+		verified = verify_batched_gemm<FloatType>(mat, m, n, result, size, batchCount, false) && verified;
+
+	    cl_ulong bestTime = 0u;
+
+	    for (unsigned pass = 0u; pass < pass_count; pass++)
+	    {
+		Event event = mat.multiplyBatched<FloatType>(m, 0u, n, 0u, result, 0u, size, size, size, batchCount, strategy);
+		mat.waitForCompletion();
+
+		cl_ulong const kernelTime = event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+
+		bestTime = pass ? min(bestTime, kernelTime) : kernelTime;
+	    }
+
+	    if (bestTime)
+		cout << "\t    " << setw(6) << batchCount << " x " << setw(2) << size << 'x' << setw(2) << size << ", "
+		     << (strategy == BatchStrategy::ItemPerMatrix ? "item " : "group") << " per product: " << fixed << setprecision(2)
+		     << setw(10) << 2.0 * batchCount * size * size * size / bestTime << " GFLOPS (" << setprecision(3) << bestTime / 1.0e6 << " ms)"
+		     << (Matrix::batchStrategy(size, size, size, BatchStrategy::Auto) == strategy ? ", auto" : "") << endl;
+	}
+
+	if (verify)
+	{
+	    // Products stored in reverse order in the result, with the offsets of each product
+	    vector<cl_ulong> offsets(3u * batchCount);
+
+	    for (cl::size_type b = 0u; b < batchCount; b++)
+	    {
+		offsets[3u * b] = offsets[3u * b + 1u] = b * size * size;
+		offsets[3u * b + 2u] = (batchCount - 1u - b) * size * size;
+	    }
+
+	    Buffer offsetsBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_ulong) * offsets.size(), offsets.data());
+
+	    mat.multiplyBatched<FloatType>(m, n, result, offsetsBuffer, size, size, size, batchCount);
+	    mat.waitForCompletion();
+
+	    verified = verify_batched_gemm<FloatType>(mat, m, n, result, size, batchCount, true) && verified;
+	}
+    }
+
+    return verified;
+}
+
+// Check sampled tiles of an integer result exactly, against sums on the host
+template<typename IntegerType>
+    static bool verify_integer_gemm(Matrix &mat, Buffer const &m, Buffer const &n, Buffer const &result, cl::size_type size)
+{
+    cl::size_type const
+	tileSize = std::min(size, GEMM_VERIFY_TILE_SIZE),
+	tilePositions[][2] = { { 0u, 0u }, { size / 2u, size / 3u }, { size - tileSize, size - tileSize } };
+
+    vector<IntegerType> hostM, hostN;
+    vector<cl_int> tile;
+
+    mat.readBufferRect(m, size, size, 0u, 0u, size, size, hostM);
+    mat.readBufferRect(n, size, size, 0u, 0u, size, size, hostN);
+
+    for (auto const &position: tilePositions)
+    {
+	mat.readBufferRect(result, size, size, position[0], position[1], tileSize, tileSize, tile);
+
+	for (cl::size_type i = 0u; i < tileSize; i++)
+	    for (cl::size_type j = 0u; j < tileSize; j++)
+	    {
+		cl_long expected = 0;
+
+		for (cl::size_type k = 0u; k < size; k++)
+		    expected += static_cast<cl_long>(hostM[(position[0] + i) * size + k]) * hostN[k * size + position[1] + j];
+
+		if (tile[i * tileSize + j] != expected)
+		{
+		    clog << "\t    Verification FAILED for " << size << 'x' << size << " at (" << position[0] + i << ", " << position[1] + j << "): "
+			 << tile[i * tileSize + j] << " instead of " << expected << endl;
+
+		    return false;
+		}
+	    }
+    }
+
+    return true;
+}
+
+// Largest maxValue for elements in [-maxValue - 1, maxValue] such that the int sums of size products do not
+// overflow, within the range of the element type
+template<typename IntegerType>
+    static cl_int integer_gemm_max_value(cl::size_type size)
+{
+    cl_long const maxValue = static_cast<cl_long>(std::sqrt(static_cast<double>(numeric_limits<cl_int>::max()) / size)) - 1;
+
+    return static_cast<cl_int>(min<cl_long>(maxValue, numeric_limits<IntegerType>::max()));
+}
+
+// Multiply square integer matrices of doubling sizes, and report the best speed out of pass_count runs
+// in TOPS (tera integer operations per second), timed with the kernel profiling events. Elements take
+// the widest range for which the int sums do not overflow, see integer_gemm_max_value(), that for
+// short elements goes well past the char range.
+template<typename IntegerType>
+    static bool probe_gemm_integer(Device &device, Matrix &mat, char const *typeName, unsigned int pass_count, bool verify)
+{
+    cl::size_type const
+	maxAllocSize = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>(),
+	globalMemSize = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+
+    bool verified = true;
+
+    clog << "\tInteger matrix multiplication (" << typeName << ", int sums, " << (mat.hasDotProduct() ? "cl_khr_integer_dot_product" : "no dot product extension") << "):" << endl;
+
+    for (cl::size_type size = GEMM_PROBE_MIN_SIZE; size <= GEMM_PROBE_MAX_SIZE; size *= 2u)
+    {
+	cl::size_type const resultSize = sizeof(cl_int) * size * size;
+
+	if (resultSize > maxAllocSize || resultSize + 2u * sizeof(IntegerType) * size * size > globalMemSize / 2u)
+	    break;
+
+	cl_int const maxValue = integer_gemm_max_value<IntegerType>(size);
+	Buffer
+	    m = mat.createBuffer<IntegerType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY),
+	    n = mat.createBuffer<IntegerType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY),
+	    result = mat.createBuffer<cl_int>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY);
+
+	mat.random_fill_integer<IntegerType>(m, size, size, -maxValue - 1, maxValue, size, 0u);
+	mat.random_fill_integer<IntegerType>(n, size, size, -maxValue - 1, maxValue, size, 1u);
+
+	cl_ulong bestTime = 0u;
+
+	// The first run includes building the kernels
+	for (unsigned pass = 0u; pass <= pass_count; pass++)
+	{
+	    Event event = mat.multiply_integer<IntegerType>(m, n, result, size, size, size);
+	    mat.waitForCompletion();
+
+	    cl_ulong const kernelTime = event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+
+	    if (pass)
+		bestTime = pass > 1u ? min(bestTime, kernelTime) : kernelTime;
+	}
+
+	if (verify)
+	    verified = verify_integer_gemm<IntegerType>(mat, m, n, result, size) && verified;
+
+	if (bestTime)
+	    cout << "\t    " << setw(5) << size << 'x' << setw(5) << size << ": " << fixed << setprecision(3)
+		 << setw(10) << 2.0 * size * size * size / bestTime / 1.0e3 << " TOPS (" << bestTime / 1.0e6 << " ms), elements in ["
+		 << -maxValue - 1 << ", " << maxValue << ']' << endl;
+    }
+
+    return verified;
+}
+
+// IEEE 754 half value on the host, to compare results stored as half
+static float half_to_float(cl_half value)
+{
+    int const exponent = value >> 10 & 0x1F, mantissa = value & 0x3FF;
+    float const magnitude =
+	exponent == 0x1F ? (mantissa ? numeric_limits<float>::quiet_NaN() : numeric_limits<float>::infinity()) :
+	exponent ? std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25) : std::ldexp(static_cast<float>(mantissa), -24);
+
+    return value & 0x8000 ? -magnitude : magnitude;
+}
+
+// Multiply square matrices stored as half, with float sums, and report the speedup over the float
+// multiplication of the same matrices, and the relative error of the half results against the float
+// results, that includes the rounding of the operands to half
+static void probe_gemm_half(Device &device, Matrix &mat, unsigned int pass_count)
+{
+    cl::size_type const
+	maxAllocSize = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>(),
+	globalMemSize = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+
+    clog << "\tMatrix multiplication with half storage and float sums:" << endl;
+
+    for (cl::size_type size = GEMM_PROBE_MIN_SIZE; size <= GEMM_PROBE_MAX_SIZE; size *= 2u)
+    {
+	cl::size_type const bufferSize = sizeof(cl_float) * size * size;
+
+	if (bufferSize > maxAllocSize || 3u * (bufferSize + bufferSize / 2u) > globalMemSize / 2u)
+	    break;
+
+	Buffer
+	    m = mat.createBuffer<cl_float>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS),
+	    n = mat.createBuffer<cl_float>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS),
+	    result = mat.createBuffer<cl_float>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY),
+	    halfM = mat.createBuffer<cl_half>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS),
+	    halfN = mat.createBuffer<cl_half>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS),
+	    halfResult = mat.createBuffer<cl_half>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY);
+
+	// Small values, so the sums stay in the half range
+	mat.random_fill<cl_float>(m, size, size, -1.0f, 1.0f, size, 0u);
+	mat.random_fill<cl_float>(n, size, size, -1.0f, 1.0f, size, 1u);
+	mat.convert_to_half<cl_float>(m, halfM, size * size);
+	mat.convert_to_half<cl_float>(n, halfN, size * size);
+
+	auto bestTime = [&mat, pass_count](auto multiply)
+	{
+	    cl_ulong best = 0u;
+
+	    // The first run includes building the kernels
+	    for (unsigned pass = 0u; pass <= pass_count; pass++)
+	    {
+		Event event = multiply();
+		mat.waitForCompletion();
+
+		cl_ulong const time = event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+
+		if (pass)
+		    best = pass > 1u ? min(best, time) : time;
+	    }
+
+	    return best;
+	};
+
+	cl_ulong const
+	    floatTime = bestTime([&]() { return mat.gemm<cl_float>(false, false, size, size, size, 1.0f, m, n, 0.0f, result); }),
+	    halfTime = bestTime([&]() { return mat.gemm_half(false, false, size, size, size, 1.0f, halfM, halfN, 0.0f, halfResult); });
+
+	if (!floatTime || !halfTime)
+	    continue;
+
+	vector<cl_float> floatValues, halfValues(size * size);
+	vector<cl_half> halfElements;
+
+	mat.readBufferRect(result, size, size, 0u, 0u, size, size, floatValues);
+	mat.readBufferRect(halfResult, size, size, 0u, 0u, size, size, halfElements);
+	std::transform(halfElements.begin(), halfElements.end(), halfValues.begin(), half_to_float);
+
+	double const flops = 2.0 * size * size * size;
+
+	cout << "\t    " << setw(5) << size << 'x' << setw(5) << size << ": " << fixed << setprecision(2)
+	     << setw(10) << flops / halfTime << " GFLOPS (float " << flops / floatTime << " GFLOPS, speedup " << static_cast<double>(floatTime) / halfTime << "x), "
+	     << "relative error " << std::scientific << setprecision(3) << relative_error(halfValues.data(), floatValues.data(), floatValues.size())
+	     << std::defaultfloat << endl;
+    }
+}
+
+// Square host matrices with a simple pattern of small values, for the multiplications from host memory
+template<typename FloatType>
+    static void fill_host_matrices(vector<FloatType> &m, vector<FloatType> &n, cl::size_type size)
+{
+    m.resize(size * size);
+    n.resize(size * size);
+
+    for (cl::size_type i = 0u; i < size; i++)
+	for (cl::size_type j = 0u; j < size; j++)
+	{
+	    m[i * size + j] = static_cast<FloatType>(static_cast<int>((i * 37u + j * 11u) % 201u) - 100) / 16;
+	    n[i * size + j] = static_cast<FloatType>(static_cast<int>((i * 13u + j * 29u) % 199u) - 99) / 16;
+	}
+}
+
+// Check sampled tiles of a result in host memory against the host multiplication
+template<typename FloatType>
+    static bool verify_host_tiles(vector<FloatType> const &m, vector<FloatType> const &n, vector<FloatType> const &result, cl::size_type size)
+{
+    cl::size_type const
+	tileSize = std::min(size, GEMM_VERIFY_TILE_SIZE),
+	tilePositions[][2] = { { 0u, 0u }, { size / 2u, size / 3u }, { size - tileSize, size - tileSize } };
+
+    vector<FloatType> expected(tileSize * tileSize), actual(tileSize * tileSize);
+    double maxError = 0.0;
+
+    for (auto const &position: tilePositions)
+    {
+	host_multiply(tileSize, tileSize, size, &m[position[0] * size], size, &n[position[1]], size, expected.data(), tileSize);
+
+	for (cl::size_type i = 0u; i < tileSize; i++)
+	    std::copy_n(&result[(position[0] + i) * size + position[1]], tileSize, &actual[i * tileSize]);
+
+	maxError = std::max(maxError, relative_error(actual.data(), expected.data(), expected.size()));
+    }
+
+    if (maxError > size * numeric_limits<FloatType>::epsilon())
+    {
+	clog << "\t    Verification FAILED: relative error " << std::scientific << setprecision(3) << maxError << std::defaultfloat << endl;
+	return false;
+    }
+
+    return true;
+}
+
+// Multiply host matrices of the given size with the streamed (out-of-core) multiplication, and report the
+// sustained speed, including all transfers. Optionally verify sampled tiles of the result on the host.
+template<typename FloatType>
+    static bool probe_gemm_stream(Device &device, char const *typeName, cl::size_type size, cl::size_type maxBlockSize, CmdLineArgs const &args)
+{
+    Context context(device);
+    MatrixStream mat(context, args.vector_width);
+    vector<FloatType> m, n, result(size * size);
+
+    fill_host_matrices(m, n, size);
+
+    cl::size_type const blockSize = mat.blockSize<FloatType>(maxBlockSize);
+
+    clog << "\tStreamed matrix multiplication (" << typeName << ", " << size << 'x' << size << ", " << blockSize << 'x' << blockSize << " blocks):" << endl;
+
+    double bestSpeed = 0.0;
+
+    for (unsigned pass = 0u; pass < std::max(args.pass_count, 1u); pass++)
+    {
+	auto const startTime = steady_clock::now();
+
+	mat.multiply_streamed(m.data(), n.data(), result.data(), size, size, size, maxBlockSize);
+
+	bestSpeed = std::max(bestSpeed, 2.0 * size * size * size / duration<double, std::nano>(steady_clock::now() - startTime).count());
+    }
+
+    cout << "\t    " << setw(5) << size << 'x' << setw(5) << size << ": " << fixed << setprecision(2) << setw(10) << bestSpeed << " GFLOPS sustained, including transfers" << endl;
+
+    return !args.verify_gemm || verify_host_tiles(m, n, result, size);
+}
+
+// Compare the Strassen-Winograd multiplication with the direct kernel for square matrices of increasing
+// size, and report the effective speed of both (2n^3 / time, with the time of the direct method, for the
+// same result) and the relative error of the Strassen-Winograd result against the direct result
+template<typename FloatType>
+    static void probe_gemm_strassen(MatrixStrassen &mat, char const *typeName, unsigned int pass_count)
+{
+    cl::size_type const crossover = mat.crossover<FloatType>();
+
+    if (!crossover)
+    {
+	clog << "\tStrassen-Winograd matrix multiplication (" << typeName << "): crossover not tuned, the matrices do not fit in the device memory" << endl;
+	return;
+    }
+
+    clog << "\tStrassen-Winograd matrix multiplication (" << typeName << ", crossover " << crossover << "):" << endl;
+
+    for (cl::size_type size = STRASSEN_PROBE_MIN_SIZE; size <= GEMM_PROBE_MAX_SIZE && mat.fits<FloatType>(size, 4u); size *= 2u)
+    {
+	Buffer
+	    m = mat.createBuffer<FloatType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS),
+	    n = mat.createBuffer<FloatType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS),
+	    direct = mat.createBuffer<FloatType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY),
+	    strassen = mat.createBuffer<FloatType>(size, size, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY);
+
+	mat.random_fill<FloatType>(m, size, size, -1.0f, 1.0f, size, 0u);
+	mat.random_fill<FloatType>(n, size, size, -1.0f, 1.0f, size, 1u);
+
+	auto bestTime = [&mat, pass_count](auto multiply)
+	{
+	    double best = 0.0;
+
+	    // The first run includes building the kernels
+	    for (unsigned pass = 0u; pass <= pass_count; pass++)
+	    {
+		auto const startTime = steady_clock::now();
+
+		multiply();
+		mat.waitForCompletion();
+
+		double const time = duration<double, std::nano>(steady_clock::now() - startTime).count();
+
+		if (pass)
+		    best = pass > 1u ? min(best, time) : time;
+	    }
+
+	    return best;
+	};
+
+	double const
+	    directTime = bestTime([&]() { mat.gemm<FloatType>(false, false, size, size, size, 1, m, n, 0, direct); }),
+	    strassenTime = bestTime([&]() { mat.multiply_strassen<FloatType>(m, n, strassen, size, crossover); });
+
+	vector<FloatType> directResult, strassenResult;
+
+	mat.readBufferRect(direct, size, size, 0u, 0u, size, size, directResult);
+	mat.readBufferRect(strassen, size, size, 0u, 0u, size, size, strassenResult);
+
+	double const flops = 2.0 * size * size * size;
+
+	cout << "\t    " << setw(5) << size << 'x' << setw(5) << size << ": "
+	     << fixed << setprecision(2) << setw(10) << flops / directTime << " GFLOPS direct, "
+	     << setw(10) << flops / strassenTime << " GFLOPS effective with " << MatrixStrassen::recursionDepth(size, crossover) << " levels, "
+	     << "relative error " << std::scientific << setprecision(3) << relative_error(strassenResult.data(), directResult.data(), directResult.size())
+	     << std::defaultfloat << endl;
+    }
+}
+
+static bool probe_gemm(Device &device, CmdLineArgs const &args)
+{
+    if (args.stream_size)
+	return probe_gemm_stream<cl_float>(device, "float", args.stream_size, args.stream_block, args);
+
+    if (args.strassen)
+    {
+	Context context(device);
+	MatrixStrassen mat(context, args.vector_width);
+	unsigned int const pass_count = args.pass_count ? args.pass_count : 1u;
+
+	probe_gemm_strassen<cl_float>(mat, "float", pass_count);
+
+	if (mat.supports<cl_double>())
+	    probe_gemm_strassen<cl_double>(mat, "double", pass_count);
+
+	return true;
+    }
+
+    Context context(device);
+    Matrix mat(context, args.vector_width, CL_QUEUE_PROFILING_ENABLE);
+    unsigned int const pass_count = args.pass_count ? args.pass_count : 1u;
+
+    bool result = probe_gemm_speed<cl_float>(device, mat, "float", pass_count, args.probe_delay, args.verify_gemm);
+
+    if (args.half_storage)
+	probe_gemm_half(device, mat, pass_count);
+
+    if (args.batched_gemm)
+    {
+	result = probe_gemm_batched<cl_float>(device, context, mat, "float", pass_count, args.verify_gemm) && result;
+
+	if (mat.supports<cl_double>())
+	    result = probe_gemm_batched<cl_double>(device, context, mat, "double", pass_count, args.verify_gemm) && result;
+    }
+
+    if (args.integer_gemm)
+    {
+	result = probe_gemm_integer<cl_char>(device, mat, "char", pass_count, args.verify_gemm) && result;
+	result = probe_gemm_integer<cl_short>(device, mat, "short", pass_count, args.verify_gemm) && result;
+    }
+
+    if (mat.supports<cl_double>())
+	result = probe_gemm_speed<cl_double>(device, mat, "double", pass_count, args.probe_delay, args.verify_gemm) && result;
+
+    return result;
+}
+
+// Multiply host matrices on all the given devices, with the result blocks distributed in proportion to the
+// single-device speeds, and report the aggregate speed and the scaling efficiency
+extern bool probe_cl_devices(vector<Device> const &selectedDevices, CmdLineArgs const &args)
+{
+    vector<Device> const devices = partition_cpu_devices(selectedDevices, args.sub_devices);
+    cl::size_type const
+	size = args.stream_size ? args.stream_size : MULTI_DEVICE_GEMM_SIZE,
+	blockSize = args.stream_block ? args.stream_block : MULTI_DEVICE_GEMM_BLOCK_SIZE;
+
+    MultiDeviceMatrix mat(devices, args.vector_width);
+    vector<cl_float> m, n, result(size * size);
+
+    fill_host_matrices(m, n, size);
+
+    clog << "Multi-device matrix multiplication (float, " << size << 'x' << size << ", " << blockSize << 'x' << blockSize << " blocks):" << endl;
+
+    mat.calibrate<cl_float>(blockSize);
+
+    double totalSpeed = 0.0;
+
+    for (size_t i = 0u; i < mat.deviceCount(); i++)
+    {
+	cout << "\tDevice:                " << trim_name(mat.device(i).getInfo<CL_DEVICE_NAME>()) << ": "
+	     << fixed << setprecision(2) << mat.deviceSpeed(i) << " GFLOPS" << endl;
+
+	totalSpeed += mat.deviceSpeed(i);
+    }
+
+    double bestSpeed = 0.0;
+
+    for (unsigned pass = 0u; pass < std::max(args.pass_count, 1u); pass++)
+    {
+	auto const startTime = steady_clock::now();
+
+	mat.multiply(m.data(), n.data(), result.data(), size, size, size, blockSize);
+	bestSpeed = std::max(bestSpeed, 2.0 * size * size * size / duration<double, std::nano>(steady_clock::now() - startTime).count());
+    }
+
+    cout << "\tAggregate speed:       " << fixed << setprecision(2) << bestSpeed << " GFLOPS on " << mat.deviceCount() << " devices, "
+	 << setprecision(1) << 100.0 * bestSpeed / totalSpeed << "% scaling efficiency" << endl;
+
+    return !args.verify_gemm || verify_host_tiles(m, n, result, size);
+}
+
+extern bool probe_cl_device(Device &device, CmdLineArgs const &args)
+{
+    unsigned int const pass_count = args.pass_count;
+    unsigned long const simulation_count = args.simulation_count;
+    unsigned const delay_ms = args.probe_delay;
+
     cout << "\tDevice:                " << trim_name(device.getInfo<CL_DEVICE_NAME>()) << endl;
 
     cl_bool has_linker = false;
@@ -107,6 +1101,33 @@ extern bool probe_cl_device(Device &device, unsigned int pass_count, unsigned lo
 	    (device.getInfo(CL_DEVICE_LINKER_AVAILABLE, &has_linker), has_linker)
 	)
     {
+	if (args.tune_gemm)
+	{
+	    tune_gemm(device);
+	    return true;
+	}
+
+	if (args.build_variants)
+	{
+	    probe_build_variants(device, pass_count);
+	    return true;
+	}
+
+	if (args.probe_gemm)
+	    return probe_gemm(device, args);
+
+	if (args.item_widths)
+	{
+	    probe_item_widths(device, pass_count);
+	    return true;
+	}
+
+	if (args.precisions)
+	{
+	    probe_precisions(device, pass_count);
+	    return true;
+	}
+
 	DoublePendulumSimulation &sim = DoublePendulumSimulation::get(device);
 
 	sim.probeIterationCount(SIMULATION_STEP_PROBE_TIME);
@@ -126,7 +1147,8 @@ extern bool probe_cl_device(Device &device, unsigned int pass_count, unsigned lo
 	clog << "\tUsing granularity:     " << step_size << " workgroups" << endl;
 	clog << "\tReruns:                " << pass_count << " runs" << endl;
 
-	unique_ptr<unsigned long[]> times(new unsigned long[simulation_size * pass_count]);
+	vector<vector<cl_ulong>> times(simulation_size);
+	vector<TimingStats> stats(simulation_size);
 
 	for (unsigned pass = 0u; pass < pass_count; pass++)
 	{
@@ -135,14 +1157,23 @@ extern bool probe_cl_device(Device &device, unsigned int pass_count, unsigned lo
 	    for (size_t n = 1u; n <= simulation_size; n++)
 	    {
 		cout << "\rMultiple: " << pass + 1u << '/' << n * step_size << flush;
-		times[(n - 1) * pass_count + pass] = static_cast<unsigned long>(sim.runSimulation(NDRange(n * step_size * size_multiple), NDRange(size_multiple)));
+		times[n - 1].push_back(sim.runSimulation(NDRange(n * step_size * size_multiple), NDRange(size_multiple)));
 
 		if (delay_ms)
 		    std::this_thread::sleep_for(milliseconds(delay_ms));
 	    }
 	}
 
-	show_simulation_times(device, simulation_size, size_multiple, step_size, times.get(), pass_count);
+	// More runs for the work item counts with too wide a confidence interval after the passes
+	size_t const timer_resolution = device.getInfo<CL_DEVICE_PROFILING_TIMER_RESOLUTION>();
+
+	for (size_t n = 1u; n <= simulation_size; n++)
+	{
+	    cout << "\rStatistics: " << n * step_size << flush;
+	    stats[n - 1] = time_simulation(sim, n * step_size * size_multiple, size_multiple, timer_resolution, pass_count, times[n - 1]);
+	}
+
+	show_simulation_times(device, sim, simulation_size, size_multiple, step_size, times, stats, pass_count);
     }
     else
     {
@@ -152,104 +1183,3 @@ extern bool probe_cl_device(Device &device, unsigned int pass_count, unsigned lo
 
     return true;
 }
-
-// void list_context_devices(Context &context)
-// {
-//     vector<Device> devices(context.getInfo<CL_CONTEXT_DEVICES>());
-//
-//     for (auto &device: devices)
-// 	show_cl_device(device);
-// }
-//
-// extern void test_matrix_multiply()
-// {
-//     cl_platform_id platform;
-//     std::array<cl_context_properties, 3> context_props = { 0, 0, 0 };
-//
-//     if (!args.select_platform_name.empty())
-//     {
-//         std::vector<cl::Platform> clPlatforms;
-//         bool platform_found = false;
-//
-//         cl::Platform::get(&clPlatforms);
-//
-//         for (auto it = clPlatforms.cbegin(); !platform_found && it != clPlatforms.cend(); it++)
-//             if (!strncmp(it->getInfo<CL_PLATFORM_NAME>().data(), args.select_platform_name.data(),
-//         		std::min(it->getInfo<CL_PLATFORM_NAME>().size(), args.select_platform_name.length())))
-//             {
-//         	platform = it->Wrapper<cl_platform_id>::get();
-//         	platform_found = true;
-//             }
-//
-//         if (!platform_found)
-//             for (auto it = clPlatforms.cbegin(); !platform_found && it != clPlatforms.cend(); it++)
-//         	if(!strncmp(it->getInfo<CL_PLATFORM_VENDOR>().data(), args.select_platform_name.data(),
-//         		std::min(it->getInfo<CL_PLATFORM_VENDOR>().size(), args.select_platform_name.length())))
-//         	{
-//         	    platform = it->Wrapper<cl_platform_id>::get();
-//         	    platform_found = true;
-//         	}
-//
-//         if (!platform_found)
-//             throw std::runtime_error("No such platform: " + args.select_platform_name);
-//
-//         context_props[0] = CL_CONTEXT_PLATFORM;
-//         context_props[1] = static_cast<cl_context_properties>(reinterpret_cast<intptr_t>(platform));
-//         context_props[2] = static_cast<cl_context_properties>(0);
-//     }
-//
-//     cl::Context context(CL_DEVICE_TYPE_DEFAULT, context_props[0] ? context_props.data() : nullptr, context_error_notification);
-//
-//     if (args.list_all_devices)
-//         list_context_devices(context);
-//
-//     if (args.probe)
-//     {
-//         cout << "Probing device" << (context.getInfo<CL_CONTEXT_DEVICES>().size() > 1 ? "s" : "") << ": \n";
-//
-//         for (auto const &device: context.getInfo<CL_CONTEXT_DEVICES>())
-//             cout << '\t' << device.getInfo<CL_DEVICE_NAME>() << endl;
-//
-//         cout << endl;
-//
-//         cl_ulong const lines = 1024, cols = 1024, internal_size = 1024;
-//
-//         cl::Buffer
-//             m(context, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY /* CL_MEM_HOST_NO_ACCESS */, sizeof(cl_double) * lines * internal_size),
-//             n(context, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY /* CL_MEM_HOST_NO_ACCESS */, sizeof(cl_double) * internal_size * cols),
-//             result(context, CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, sizeof(cl_double)* lines * cols);
-//
-//         Matrix mat(context);
-//         std::vector<cl_float> sub_buffer;
-//
-//         mat.random_fill<cl_float>(m, lines, internal_size, -100.0f, 100.0f);
-//         mat.random_fill<cl_float>(n, internal_size, cols, -100.0f, 100.0f);
-//         //mat.zero_fill<cl_float>(result, lines, cols);
-//         mat.random_fill<cl_float>(result, internal_size, cols, 0.0f, 0.0001f);
-//         mat.waitForCompletion();
-//
-//
-//         std::time_t startTime, endTime;
-//         time(&startTime);
-//         mat.multiply<cl_float>(m, lines, internal_size, n, internal_size, cols, result, lines, cols);
-//         mat.waitForCompletion();
-//         time(&endTime);
-//
-//         cout << std::setprecision(5) << std::fixed << (static_cast<double>(lines) * internal_size * cols * 2 / 1000/1000/1000) / static_cast<double>(endTime - startTime) << " GFLOPS" << endl;
-//
-//
-//         // mat.readBufferRectAsync(result, lines, cols, 852, 718, 20, 20, sub_buffer);
-//         // mat.waitForCompletion();
-//
-//         mat.readBufferRect(result, lines, cols, 852, 718, 20, 20, sub_buffer);
-//
-//         cout << "Sample sub-matrix:\n";
-//         for (unsigned i = 0; i < 10; i++)
-//         {
-//             for (unsigned j = 0; j < 10; j++)
-//         	cout << std::setw(14) << std::setprecision(5) << std::fixed << std::setfill(' ') << std::setiosflags(cout.right) << std::showpos << sub_buffer[i * 10 + j] << ' ';
-//
-//             cout << endl;
-//         }
-//     }
-// }
@@ -7,7 +7,12 @@
 #include <CL/cl2.hpp>
 #endif
 
-extern bool probe_cl_device(cl::Device &device, unsigned int pass_count, unsigned long simulation_count, unsigned delay_ms);
+#include <vector>
+
+#include "parse-cmd-line.hh"
+
+extern bool probe_cl_device(cl::Device &device, CmdLineArgs const &args);
+extern bool probe_cl_devices(std::vector<cl::Device> const &devices, CmdLineArgs const &args);
 extern void probe_cl_platform(cl::Platform &platform);
 
 #endif // !defined(CL_PLATFORM_PROBE_HH)
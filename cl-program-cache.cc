@@ -0,0 +1,317 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <exception>
+#include <filesystem>
+#include <system_error>
+#include <random>
+#include <thread>
+#include <iterator>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "cl-platform-info.hh"
+#include "cl-matrix-mult.hh"
+#include "cl-gemm-tuner.hh"
+#include "cl-kernel-sources.hh"
+#include "cl-program-cache.hh"
+
+using std::size_t;
+using std::getenv;
+using std::strcmp;
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+using std::ostringstream;
+using std::istreambuf_iterator;
+using std::ios;
+using std::cerr;
+using std::endl;
+using std::hex;
+using std::setw;
+using std::setfill;
+using std::istringstream;
+
+using cl::Error;
+using cl::Context;
+using cl::Device;
+using cl::Program;
+
+namespace filesystem = std::filesystem;
+
+extern void print_build_log(Program const &program)
+{
+#if defined(CL_HPP_PARAM_NAME_INFO_1_0_)
+    auto const buildLog = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>();
+
+    if (!buildLog.empty())
+	for (auto const &output_msg: buildLog)
+	    cerr << "Build output from device " << output_msg.first.getInfo<CL_DEVICE_NAME>() << ":\n\t" << output_msg.second << endl;
+#else
+    string deviceBuildLog;
+
+    program.getInfo(CL_PROGRAM_BUILD_LOG, &deviceBuildLog);
+    cerr << "Build output:\n" << deviceBuildLog;
+#endif
+}
+
+extern string program_cache_key(string const &deviceName, string const &driverVersion, string const &source, string const &options)
+{
+    ostringstream key;
+
+    key << trim_name(deviceName) << '\t' << trim_name(driverVersion) << '\t' << options << '\t' << hex << setw(16) << setfill('0') << source_hash(source);
+
+    return key.str();
+}
+
+static string program_cache_key(Device const &device, string const &source, string const &options)
+{
+    return program_cache_key(device.getInfo<CL_DEVICE_NAME>(), device.getInfo<CL_DRIVER_VERSION>(), source, options);
+}
+
+static filesystem::path program_cache_file(string const &key)
+{
+    ostringstream fileName;
+
+    fileName << hex << setw(16) << setfill('0') << source_hash(key) << ".bin";
+
+    return filesystem::path(user_cache_directory()) / "programs" / fileName.str();
+}
+
+static bool load_program_binary(string const &key, vector<unsigned char> &binary)
+{
+    ifstream cacheFile(program_cache_file(key), ios::in | ios::binary);
+    string fileKey;
+
+    if (!std::getline(cacheFile, fileKey) || fileKey != key)
+	return false;
+
+    binary.assign(istreambuf_iterator<char>(cacheFile), istreambuf_iterator<char>());
+
+    return !binary.empty();
+}
+
+// The cache only saves build time, so a cache directory that can not be written is not an error. The binary
+// is written to a temporary file, unique to the thread, and renamed over the cache file when complete, as
+// devices with the same key may be built at the same time (see DoublePendulumSimulation::buildAll()), and a
+// reader should never load a partly written file.
+static void save_program_binary(string const &key, vector<unsigned char> const &binary)
+{
+    filesystem::path const fileName = program_cache_file(key);
+    filesystem::path tempName;
+
+    try
+    {
+	ostringstream tempSuffix;
+
+	tempSuffix << ".tmp-" << hex << std::random_device()() << '-' << std::this_thread::get_id();
+	tempName = fileName.string() + tempSuffix.str();
+
+	filesystem::create_directories(fileName.parent_path());
+
+	{
+	    ofstream cacheFile(tempName, ios::out | ios::binary | ios::trunc);
+
+	    cacheFile.exceptions(cacheFile.exceptions() | cacheFile.badbit | cacheFile.failbit);
+	    cacheFile << key << '\n';
+	    cacheFile.write(reinterpret_cast<char const *>(binary.data()), binary.size());
+	    cacheFile.close();
+	}
+
+	filesystem::rename(tempName, fileName);
+    }
+    catch (std::exception const &ex)
+    {
+	std::error_code error;
+
+	if (!tempName.empty())
+	    filesystem::remove(tempName, error);
+	cerr << "Program cache not saved: " << ex.what() << endl;
+    }
+}
+
+extern Program build_cached_program(Context const &context, string const &source, string const &options)
+{
+    vector<Device> const devices = context.getInfo<CL_CONTEXT_DEVICES>();
+    vector<string> keys;
+    Program::Binaries binaries(devices.size());
+    bool cached = true;
+
+    for (size_t i = 0u; i < devices.size(); i++)
+    {
+	keys.push_back(program_cache_key(devices[i], source, options));
+	cached = load_program_binary(keys.back(), binaries[i]) && cached;
+    }
+
+    if (cached)
+	try
+	{
+	    Program program(context, devices, binaries);
+
+	    program.build(devices, options.c_str());
+
+	    return program;
+	}
+	catch (Error const &error)
+	{
+	    if (error.err() != CL_INVALID_BINARY && error.err() != CL_BUILD_PROGRAM_FAILURE)
+		throw;
+	}
+
+    Program program(context, source, false);
+
+    try
+    {
+	program.build(devices, options.c_str());
+    }
+    catch (Error const &error)
+    {
+	if (error.err() == CL_BUILD_PROGRAM_FAILURE)
+	    print_build_log(program);
+
+	throw;
+    }
+
+    auto const programBinaries = program.getInfo<CL_PROGRAM_BINARIES>();
+
+    for (size_t i = 0u; i < programBinaries.size() && i < keys.size(); i++)
+	if (!programBinaries[i].empty())
+	    save_program_binary(keys[i], programBinaries[i]);
+
+    return program;
+}
+
+// SPIR-V module and its build options, built into the executable next to the OpenCL sources, see the
+// spirv target in CMakeLists.txt. Modules are not used with CL_TOOL_KERNEL_DIR, as they may not match
+// the sources there.
+static bool find_il_module(char const *fileName, string const &options, string &il)
+{
+    char const *kernelDir = getenv("CL_TOOL_KERNEL_DIR");
+
+    if (kernelDir && *kernelDir)
+	return false;
+
+    string moduleName(fileName);
+
+    if (moduleName.size() > 3u && !moduleName.compare(moduleName.size() - 3u, 3u, ".cl"))
+	moduleName.erase(moduleName.size() - 3u);
+
+    moduleName += ".spv";
+
+    string const optionsName = moduleName + "-options";
+    EmbeddedSource const *module = nullptr, *moduleOptions = nullptr;
+
+    for (size_t i = 0u; i < embedded_source_count; i++)
+	if (!strcmp(embedded_sources[i].fileName, moduleName.c_str()))
+	    module = embedded_sources + i;
+	else
+	    if (!strcmp(embedded_sources[i].fileName, optionsName.c_str()))
+		moduleOptions = embedded_sources + i;
+
+    if (!module || !moduleOptions || string(moduleOptions->text, moduleOptions->length) != options)
+	return false;
+
+    il.assign(module->text, module->length);
+
+    return true;
+}
+
+// The modules are compiled for the spir64 target
+static bool has_il_program(Device const &device)
+{
+    if (device.getInfo<CL_DEVICE_ADDRESS_BITS>() != 64u)
+	return false;
+
+    if (has_extension(device.getInfo<CL_DEVICE_EXTENSIONS>(), "cl_khr_il_program"))
+	return true;
+
+    // "OpenCL <major>.<minor> <platform-specific information>"
+    istringstream version(device.getInfo<CL_DEVICE_VERSION>().substr(sizeof "OpenCL"));
+    unsigned major = 0u, minor = 0u;
+    char dot = '\0';
+
+    version >> major >> dot >> minor;
+
+    return major > 2u || (major == 2u && minor >= 1u);
+}
+
+typedef cl_program (CL_API_CALL *CreateProgramWithILFn)(cl_context context, void const *il, size_t length, cl_int *errcode_ret);
+
+static Program create_il_program(Context const &context, Device const &device, string const &il)
+{
+    cl_int error = CL_INVALID_OPERATION;
+    cl_program program = nullptr;
+
+#if defined(CL_VERSION_2_1)
+    if (!has_extension(device.getInfo<CL_DEVICE_EXTENSIONS>(), "cl_khr_il_program"))
+	program = ::clCreateProgramWithIL(context(), il.data(), il.size(), &error);
+    else
+#endif
+    {
+	auto createProgramWithIL = reinterpret_cast<CreateProgramWithILFn>
+	    (
+		::clGetExtensionFunctionAddressForPlatform(device.getInfo<CL_DEVICE_PLATFORM>(), "clCreateProgramWithILKHR")
+	    );
+
+	if (createProgramWithIL)
+	    program = createProgramWithIL(context(), il.data(), il.size(), &error);
+    }
+
+    if (!program)
+	throw Error(error, "clCreateProgramWithIL");
+
+    return Program(program);
+}
+
+extern bool build_il_program(Context const &context, char const *fileName, string const &options, Program &program)
+{
+    vector<Device> const devices = context.getInfo<CL_CONTEXT_DEVICES>();
+    string il;
+
+    if (devices.empty() || !find_il_module(fileName, options, il))
+	return false;
+
+    for (auto const &device: devices)
+	if (!has_il_program(device))
+	    return false;
+
+    try
+    {
+	Program ilProgram = create_il_program(context, devices.front(), il);
+
+	// The preprocessor options were applied when compiling the module
+	ilProgram.build(devices);
+	program = ilProgram;
+
+	return true;
+    }
+    catch (Error const &error)
+    {
+	if (error.err() != CL_INVALID_BINARY && error.err() != CL_INVALID_VALUE && error.err() != CL_BUILD_PROGRAM_FAILURE && error.err() != CL_INVALID_OPERATION)
+	    throw;
+    }
+
+    return false;
+}
+
+extern Program build_file_program(Context const &context, char const *fileName, string const &options)
+{
+    Program program;
+
+    if (build_il_program(context, fileName, options, program))
+	return program;
+
+    return build_cached_program(context, readSourceFile(fileName), options);
+}
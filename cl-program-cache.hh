@@ -0,0 +1,32 @@
+#if !defined(CL_PROGRAM_CACHE_HH)
+#define CL_PROGRAM_CACHE_HH
+
+#include <string>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+extern void print_build_log(cl::Program const &program);
+
+// Device name, driver version, build options and source hash, tab separated, also saved as the first line
+// of the cache file, to tell hash collisions apart
+extern std::string program_cache_key(std::string const &deviceName, std::string const &driverVersion, std::string const &source, std::string const &options);
+
+// Build the program for all devices in the context, from the device binaries saved by a previous run if
+// any, or else from source. The binaries are kept under user_cache_directory(), one file per device, keyed
+// by the device name, driver version, build options and source hash. A binary rejected by the driver
+// (CL_INVALID_BINARY) is built again from source, and replaced in the cache.
+extern cl::Program build_cached_program(cl::Context const &context, std::string const &source, std::string const &options);
+
+// Build the program from the SPIR-V module compiled at build time from the source file, if there is one for
+// the same build options, and all devices in the context take SPIR-V programs (OpenCL 2.1 or later, or
+// cl_khr_il_program). Returns false if the module can not be used.
+extern bool build_il_program(cl::Context const &context, char const *fileName, std::string const &options, cl::Program &program);
+
+// Build the program from the SPIR-V module for the source file if possible, or else with build_cached_program()
+extern cl::Program build_file_program(cl::Context const &context, char const *fileName, std::string const &options);
+
+#endif // !defined(CL_PROGRAM_CACHE_HH)
@@ -11,6 +11,7 @@
 #include <regex>
 #include <algorithm>
 #include <functional>
+#include <utility>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -30,6 +31,8 @@
 
 #include "cl-platform-info.hh"
 #include "cl-platform-probe.hh"
+#include "cl-double-pendulum.hh"
+#include "cl-matrix-mult.hh"
 #include "cl-user-selection.hh"
 #include "parse-cmd-line.hh"
 
@@ -43,6 +46,7 @@ using std::vector;
 using std::pair;
 using std::transform;
 using std::bind;
+using std::reference_wrapper;
 using std::toupper;
 using std::placeholders::_1;
 using std::locale;
@@ -61,9 +65,7 @@ static bool enumerate_cl_platforms
 	UserDeviceSelection	    		   &userDeviceSelection,
 	vector<pair<unsigned, vector<unsigned>>>   &platformSelection,
 	bool					    probe,
-	unsigned int				    pass_count,
-	unsigned long				    simulation_count,
-	unsigned int				    delay_ms
+	CmdLineArgs const			   &args
     )
 {
     bool result = true;
@@ -81,7 +83,7 @@ static bool enumerate_cl_platforms
 
 	for (unsigned device: platform.second)
 	    if (probe)
-		result = result && probe_cl_device(platformDevices[device], pass_count, simulation_count, delay_ms);
+		result = result && probe_cl_device(platformDevices[device], args);
 	    else
 		show_cl_device(platformDevices[device]);
 
@@ -116,6 +118,68 @@ static bool enumerate_cl_platforms
     return result;
 }
 
+// Build the programs for all listed and probed devices concurrently, before the output for each device,
+// that then only waits for its own build: the simulation programs the probe mode runs, or the matrix
+// programs for the GEMM modes
+static void build_device_programs
+    (
+	UserDeviceSelection				   &userDeviceSelection,
+	vector<pair<unsigned, vector<unsigned>>> const	   &listDevices,
+	vector<pair<unsigned, vector<unsigned>>> const	   &probeDevices,
+	CmdLineArgs const				   &args
+    )
+{
+    vector<reference_wrapper<Device>> devices, gemmDevices;
+
+    for (auto const &platform: listDevices)
+	for (unsigned device: platform.second)
+	    devices.push_back(userDeviceSelection.platformDevices(platform.first)[device]);
+
+    DoublePendulumSimulation::buildAll(devices);
+    devices.clear();
+
+    // The GEMM tuner and the variant builds compile their own kernel variants, one at a time
+    if (args.tune_gemm || args.build_variants)
+	return;
+
+    for (auto const &platform: probeDevices)
+	for (unsigned device: platform.second)
+	    (args.multi_device || args.probe_gemm ? gemmDevices : devices).push_back(userDeviceSelection.platformDevices(platform.first)[device]);
+
+    if (!gemmDevices.empty())
+    {
+	Matrix::buildAll(gemmDevices, args.vector_width);
+	return;
+    }
+
+    if (args.item_widths)
+    {
+	DoublePendulumSimulation::buildAll
+	    (
+		devices,
+		{
+		    { SimulationPrecision::Single, 1u }, { SimulationPrecision::Single, 2u },
+		    { SimulationPrecision::Single, 4u }, { SimulationPrecision::Single, 8u }
+		}
+	    );
+
+	return;
+    }
+
+    if (args.precisions)
+    {
+	DoublePendulumSimulation::buildAll
+	    (
+		devices,
+		{ { SimulationPrecision::Single, 1u }, { SimulationPrecision::Double, 1u }, { SimulationPrecision::Half, 1u } }
+	    );
+
+	return;
+    }
+
+    DoublePendulumSimulation::buildAll(devices);
+}
+
 int main(int argc, char const *argv[])
 try
 {
@@ -140,12 +204,25 @@ try
 
     if (result)
     {
-	result = result && enumerate_cl_platforms(platformList, userDeviceSelection, listDevices, false, args.pass_count, args.simulation_count, args.probe_delay);
+	build_device_programs(userDeviceSelection, listDevices, probeDevices, args);
+
+	result = result && enumerate_cl_platforms(platformList, userDeviceSelection, listDevices, false, args);
 
 	if (!listDevices.empty() && !probeDevices.empty())
 	    cout << endl;
 
-	result = result && enumerate_cl_platforms(platformList, userDeviceSelection, probeDevices, true, args.pass_count, args.simulation_count, args.probe_delay);
+	if (args.multi_device)
+	{
+	    vector<Device> devices;
+
+	    for (auto const &platform: probeDevices)
+		for (unsigned device: platform.second)
+		    devices.push_back(userDeviceSelection.platformDevices(platform.first)[device]);
+
+	    result = result && probe_cl_devices(devices, args);
+	}
+	else
+	    result = result && enumerate_cl_platforms(platformList, userDeviceSelection, probeDevices, true, args);
     }
 
     return result ? EXIT_SUCCESS : EXIT_FAILURE ;
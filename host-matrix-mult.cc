@@ -0,0 +1,131 @@
+#include <cstddef>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "host-matrix-mult.hh"
+
+using std::size_t;
+using std::min;
+using std::max;
+using std::fill_n;
+using std::atomic;
+using std::thread;
+using std::vector;
+
+// Cache blocking: HOST_BLOCK_INNER lines of n with HOST_BLOCK_COLS columns each should stay in the L2 cache
+// while a thread runs over HOST_BLOCK_LINES lines of m and result. The innermost loop runs over contiguous
+// columns of n and result, with no dependency between iterations, so the compiler vectorizes it.
+static size_t const
+    HOST_BLOCK_LINES = 32u,
+    HOST_BLOCK_COLS  = 256u,
+    HOST_BLOCK_INNER = 128u;
+
+template<typename FloatType>
+    static void multiply_lines
+	(
+	    size_t firstLine, size_t lastLine, size_t cols, size_t inner,
+	    FloatType const *m, size_t m_stride,
+	    FloatType const *n, size_t n_stride,
+	    FloatType *result, size_t result_stride
+	)
+{
+    for (size_t i = firstLine; i < lastLine; i++)
+	fill_n(result + i * result_stride, cols, FloatType());
+
+    for (size_t kBlock = 0u; kBlock < inner; kBlock += HOST_BLOCK_INNER)
+	for (size_t jBlock = 0u; jBlock < cols; jBlock += HOST_BLOCK_COLS)
+	{
+	    size_t const kEnd = min(inner, kBlock + HOST_BLOCK_INNER), jEnd = min(cols, jBlock + HOST_BLOCK_COLS);
+
+	    for (size_t i = firstLine; i < lastLine; i++)
+	    {
+		FloatType const *mLine = m + i * m_stride;
+		FloatType *resultLine = result + i * result_stride;
+		size_t k = kBlock;
+
+		// Four lines of n for each pass over the result line, to save loads and stores of the result
+		for (; k + 4u <= kEnd; k += 4u)
+		{
+		    FloatType const
+			a0 = mLine[k], a1 = mLine[k + 1u], a2 = mLine[k + 2u], a3 = mLine[k + 3u],
+			*n0 = n + k * n_stride, *n1 = n0 + n_stride, *n2 = n1 + n_stride, *n3 = n2 + n_stride;
+
+		    for (size_t j = jBlock; j < jEnd; j++)
+			resultLine[j] += a0 * n0[j] + a1 * n1[j] + a2 * n2[j] + a3 * n3[j];
+		}
+
+		for (; k < kEnd; k++)
+		{
+		    FloatType const a = mLine[k], *nLine = n + k * n_stride;
+
+		    for (size_t j = jBlock; j < jEnd; j++)
+			resultLine[j] += a * nLine[j];
+		}
+	    }
+	}
+}
+
+template<typename FloatType>
+    void host_multiply
+	(
+	    size_t lines, size_t cols, size_t inner,
+	    FloatType const *m, size_t m_stride,
+	    FloatType const *n, size_t n_stride,
+	    FloatType *result, size_t result_stride,
+	    unsigned threadCount
+	)
+{
+    size_t const blockCount = (lines + HOST_BLOCK_LINES - 1u) / HOST_BLOCK_LINES;
+
+    if (!threadCount)
+	threadCount = max(thread::hardware_concurrency(), 1u);
+
+    threadCount = static_cast<unsigned>(min<size_t>(threadCount, blockCount));
+
+    atomic<size_t> nextBlock(0u);
+
+    auto multiplyBlocks = [&]()
+    {
+	for (size_t block = nextBlock++; block < blockCount; block = nextBlock++)
+	    multiply_lines(block * HOST_BLOCK_LINES, min(lines, (block + 1u) * HOST_BLOCK_LINES), cols, inner, m, m_stride, n, n_stride, result, result_stride);
+    };
+
+    vector<thread> threads;
+
+    for (unsigned i = 1u; i < threadCount; i++)
+	threads.emplace_back(multiplyBlocks);
+
+    multiplyBlocks();
+
+    for (auto &worker: threads)
+	worker.join();
+}
+
+template<typename FloatType>
+    double relative_error(FloatType const *values, FloatType const *expected, size_t count)
+{
+    double maxError = 0.0, maxValue = 0.0;
+
+    for (size_t i = 0u; i < count; i++)
+    {
+	maxError = max(maxError, std::abs(static_cast<double>(values[i]) - static_cast<double>(expected[i])));
+	maxValue = max(maxValue, std::abs(static_cast<double>(expected[i])));
+    }
+
+    return maxValue > 0.0 ? maxError / maxValue : maxError;
+}
+
+template void host_multiply<cl_float>(size_t, size_t, size_t, cl_float const *, size_t, cl_float const *, size_t, cl_float *, size_t, unsigned);
+template void host_multiply<cl_double>(size_t, size_t, size_t, cl_double const *, size_t, cl_double const *, size_t, cl_double *, size_t, unsigned);
+
+template double relative_error<cl_float>(cl_float const *, cl_float const *, size_t);
+template double relative_error<cl_double>(cl_double const *, cl_double const *, size_t);
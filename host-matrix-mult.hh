@@ -0,0 +1,24 @@
+#if !defined(HOST_MATRIX_MULT_HH)
+#define HOST_MATRIX_MULT_HH
+
+#include <cstddef>
+
+// Reference matrix multiplication on the host: result = m * n, for row-major matrices with the given
+// line lengths (leading dimensions), so a tile of a larger matrix can be computed in place. Uses all
+// hardware threads with a threadCount of 0.
+template<typename FloatType>
+    void host_multiply
+	(
+	    std::size_t lines, std::size_t cols, std::size_t inner,
+	    FloatType const *m, std::size_t m_stride,
+	    FloatType const *n, std::size_t n_stride,
+	    FloatType *result, std::size_t result_stride,
+	    unsigned threadCount = 0u
+	);
+
+// Largest absolute difference between the values and the expected values, relative to the largest
+// expected value
+template<typename FloatType>
+    double relative_error(FloatType const *values, FloatType const *expected, std::size_t count);
+
+#endif // !defined(HOST_MATRIX_MULT_HH)
@@ -21,6 +21,12 @@ void SyntaxError::showSyntax(char const *cmd_name)
     cerr << "\t" << cmd_name << " [ --include-defaults ]" << endl;
     cerr << "\t" << cmd_name << " [ [--list] [--probe [--max-count 500] [--probe-delay 0] [--pass-count 3]] --platforms [--devices] ] " << endl;
     cerr << "\t" << cmd_name << " [ [--list] [--probe [--max-count 500] [--probe-delay 0] [--pass-count 3]] --platform \"Name\" [--devices | --device \"Name\" ]... ]... " << endl;
+    cerr << "\t" << cmd_name << " --probe-gemm [--verify] [--stream-size N [--stream-block N]] [--strassen] [--half-storage] [--batched] [--integer-gemm] [--vector-width 0] [--pass-count 3] [ --platforms [--devices] | --platform \"Name\" [--devices | --device \"Name\" ]... ]... " << endl;
+    cerr << "\t" << cmd_name << " --multi-device [--sub-devices N] [--verify] [--stream-size 8192 [--stream-block 1024]] [ --platforms [--devices] | --platform \"Name\" [--devices | --device \"Name\" ]... ]... " << endl;
+    cerr << "\t" << cmd_name << " --tune-gemm [ --platforms [--devices] | --platform \"Name\" [--devices | --device \"Name\" ]... ]... " << endl;
+    cerr << "\t" << cmd_name << " --precisions [--pass-count 3] [ --platforms [--devices] | --platform \"Name\" [--devices | --device \"Name\" ]... ]... " << endl;
+    cerr << "\t" << cmd_name << " --item-widths [--pass-count 3] [ --platforms [--devices] | --platform \"Name\" [--devices | --device \"Name\" ]... ]... " << endl;
+    cerr << "\t" << cmd_name << " --build-variants [--pass-count 3] [ --platforms [--devices] | --platform \"Name\" [--devices | --device \"Name\" ]... ]... " << endl;
     cerr << endl;
     cerr << cmd_name << " will by default attempt to probe the default OpenCL device(s) using a trivial matrix" << endl;
     cerr << "multiplication and report the number of floating-point operations per second in GFLOPS." << endl;
@@ -46,7 +52,95 @@ void SyntaxError::showSyntax(char const *cmd_name)
     cerr << "\t     time in one pass during device probe. Default 0." << endl;
     cerr << "\t[--pass--count 3]" << endl;
     cerr << "\t     Number of passes when probing devices. To be able to identify random variations in excecution time" << endl;
-    cerr << "\t     chart, cl-tool probes the device multiple times." << endl;
+    cerr << "\t     chart, cl-tool probes the device multiple times. Simulations are then repeated, up to 32 times in" << endl;
+    cerr << "\t     total, until the 95% confidence interval for the median time is within 2% of the median, or as" << endl;
+    cerr << "\t     close as the device profiling timer resolution allows." << endl;
+    cerr << endl;
+    cerr << "\t--tune-gemm" << endl;
+    cerr << "\t     Instead of probing, search the tile size, work group shape, vector width and unroll count for the" << endl;
+    cerr << "\t     fastest matrix multiplication kernel on each probed device. The best configuration is saved to" << endl;
+    cerr << "\t     a tuning file in the user cache directory, for the device name, driver version and kernel" << endl;
+    cerr << "\t     source, and later runs use it for matrix multiplication on the same device." << endl;
+    cerr << endl;
+    cerr << "\t--item-widths" << endl;
+    cerr << "\t     Instead of charting the simulation times, run the simulation with 1, 2, 4 and 8 pendulums integrated" << endl;
+    cerr << "\t     by each work item, as vector lanes, and show the speed in pendulum steps per second for each, with" << endl;
+    cerr << "\t     the speedup over one pendulum per work item." << endl;
+    cerr << endl;
+    cerr << "\t--precisions" << endl;
+    cerr << "\t     Instead of charting the simulation times, run the simulation in float, double and half, and show" << endl;
+    cerr << "\t     the speed in pendulum steps per second side by side, with the ratio to the float speed. Double" << endl;
+    cerr << "\t     needs double support on the device (CL_DEVICE_DOUBLE_FP_CONFIG), and half needs cl_khr_fp16." << endl;
+    cerr << "\t     The half simulation computes the derivatives in half, and accumulates the state in float, as" << endl;
+    cerr << "\t     the update of one time step is below the half resolution of the angles." << endl;
+    cerr << endl;
+    cerr << "\t--build-variants" << endl;
+    cerr << "\t     Instead of probing, build the simulation and the matrix multiplication kernels with each set of" << endl;
+    cerr << "\t     floating-point build options: -cl-mad-enable, -cl-denorms-are-zero, -cl-finite-math-only and" << endl;
+    cerr << "\t     -cl-fast-relaxed-math, and with the simulation constants given as -D options. For each set, show" << endl;
+    cerr << "\t     the speedup over the default build, the energy drift of the simulation and the relative error" << endl;
+    cerr << "\t     of the multiplication result against the default build. The time to build the programs from" << endl;
+    cerr << "\t     source is shown first, next to the time to build them from the SPIR-V modules compiled with" << endl;
+    cerr << "\t     cl-tool, for devices that take SPIR-V (OpenCL 2.1 or cl_khr_il_program)." << endl;
+    cerr << endl;
+    cerr << "\t--probe-gemm" << endl;
+    cerr << "\t     Instead of the simulation, probe devices with the tiled matrix multiplication kernel, for square" << endl;
+    cerr << "\t     float (and double, if supported) matrices of increasing size, up to the device memory limits. Each" << endl;
+    cerr << "\t     multiplication is timed from OpenCL profiling events, and the best of --pass-count runs is" << endl;
+    cerr << "\t     reported in GFLOPS for every size, followed by the peak speed. For sizes up to 2048, the speed of the" << endl;
+    cerr << "\t     naive kernel, with no tiling, is also reported, with the speedup of the tiled kernel over it." << endl;
+    cerr << endl;
+    cerr << "\t[--verify]" << endl;
+    cerr << "\t     With --probe-gemm, check sampled tiles of each device result against a multithreaded matrix" << endl;
+    cerr << "\t     multiplication on the host, and report the host speed next to the device speed for sizes up" << endl;
+    cerr << "\t     to 2048. The products with m, n or both stored transposed are checked the same way. Probing" << endl;
+    cerr << "\t     fails if the relative error exceeds the matrix size times the type epsilon." << endl;
+    cerr << endl;
+    cerr << "\t[--stream-size N]" << endl;
+    cerr << "\t     With --probe-gemm (implied), multiply two NxN float matrices from host memory, that need not fit" << endl;
+    cerr << "\t     in the device memory or in one device buffer (CL_DEVICE_MAX_MEM_ALLOC_SIZE). The matrices are" << endl;
+    cerr << "\t     streamed to the device in blocks, with the transfers overlapping the multiplication, and the" << endl;
+    cerr << "\t     sustained speed is reported, including all transfers." << endl;
+    cerr << endl;
+    cerr << "\t[--stream-block N]" << endl;
+    cerr << "\t     Max block size for --stream-size, to force smaller blocks than the device memory allows." << endl;
+    cerr << endl;
+    cerr << "\t[--strassen]" << endl;
+    cerr << "\t     With --probe-gemm (implied), compare the Strassen-Winograd multiplication of large square matrices" << endl;
+    cerr << "\t     with the direct kernel. The crossover size, where recursion starts to pay, is first tuned for the" << endl;
+    cerr << "\t     device. For each size the effective speed (2n^3 / time) of both methods is reported, with the" << endl;
+    cerr << "\t     relative error of the Strassen-Winograd result against the direct result." << endl;
+    cerr << endl;
+    cerr << "\t[--half-storage]" << endl;
+    cerr << "\t     With --probe-gemm (implied), also multiply matrices stored as half, with float sums, and report" << endl;
+    cerr << "\t     the speedup over the float multiplication and the relative error against the float results." << endl;
+    cerr << "\t     Does not need half support (cl_khr_fp16) on the device." << endl;
+    cerr << endl;
+    cerr << "\t[--batched]" << endl;
+    cerr << "\t     With --probe-gemm (implied), also multiply batches of small square matrices (4x4 to 32x32) in one" << endl;
+    cerr << "\t     kernel launch, with one work item and with one work group for each product, and report the speed" << endl;
+    cerr << "\t     of each, marking the one picked by default. With --verify, sampled products are checked on the" << endl;
+    cerr << "\t     host, also for a batch with the offsets of each product given in a buffer." << endl;
+    cerr << endl;
+    cerr << "\t[--integer-gemm]" << endl;
+    cerr << "\t     With --probe-gemm (implied), also multiply char (int8) and short (int16) matrices with int sums," << endl;
+    cerr << "\t     and report the speed in TOPS. Elements take the widest range for which the int sums of each size" << endl;
+    cerr << "\t     cannot overflow. The char products use cl_khr_integer_dot_product if the device has it, with" << endl;
+    cerr << "\t     OpenCL C 3.0. With --verify, sampled tiles of the results are checked exactly on the host." << endl;
+    cerr << endl;
+    cerr << "\t--multi-device" << endl;
+    cerr << "\t     Multiply two float matrices in host memory on all the probed devices at once. Result blocks are" << endl;
+    cerr << "\t     dealt out to the devices in proportion to the single-device speed measured for one block, and" << endl;
+    cerr << "\t     the aggregate speed is reported, with the scaling efficiency against the sum of the device" << endl;
+    cerr << "\t     speeds. Use --stream-size and --stream-block for the matrix and block sizes." << endl;
+    cerr << endl;
+    cerr << "\t[--sub-devices N]" << endl;
+    cerr << "\t     With --multi-device, partition each CPU device into N equal sub-devices, to run the multi-device" << endl;
+    cerr << "\t     multiplication on a single machine." << endl;
+    cerr << endl;
+    cerr << "\t[--vector-width 0]" << endl;
+    cerr << "\t     Vector width for the matrix multiplication kernels: 1, 2, 4, 8 or 16. Default 0 uses the tuned" << endl;
+    cerr << "\t     width or the device preferred vector width." << endl;
     cerr << endl;
     cerr << "\t[--list][ [--probe] --platforms [--devices]" << endl;
     cerr << "\t     With --list or --show (default), show details on the available OpenCL platforms." << endl;
@@ -112,6 +206,18 @@ void CmdLineArgs::flushPendingCommand()
     }
 }
 
+// Without --list or --probe, the platform selection is listed, or probed for the GEMM modes
+void CmdLineArgs::defaultAction()
+{
+    if (!(listAction || probeAction))
+    {
+	if (tune_gemm || build_variants || item_widths || precisions || probe_gemm || multi_device)
+	    probeAction = true;
+	else
+	    listAction = true;
+    }
+}
+
 void CmdLineArgs::restartParser(bool resetActions)
 {
     if (resetActions)
@@ -140,44 +246,180 @@ char const * const *CmdLineArgs::parseGlobalOptions(char const * const argv[])
 	throw SyntaxError();
     }
 
-    if (!strncmp("--include-defaults", argv[0], sizeof "--include-defaults"))
+    // The global options are accepted in any order, until the next argument is not a global option
+    while (argv[0])
     {
-	show_defaults = true;
-	argv++;
-    }
+	char const * const *optionsStart = argv;
 
-    if (argv[0] && !strncmp("--opencl-order", argv[0], sizeof "--opencl-order"))
-    {
-	opencl_order = true;
-	argv++;
-    }
+	if (argv[0] && !strncmp("--include-defaults", argv[0], sizeof "--include-defaults"))
+	{
+	    show_defaults = true;
+	    argv++;
+	}
 
-    if (argv[0] && !strncmp("--exact-match", argv[0], sizeof "--exact-match"))
-    {
-	exact_match = true;
-	argv++;
-    }
+	if (argv[0] && !strncmp("--opencl-order", argv[0], sizeof "--opencl-order"))
+	{
+	    opencl_order = true;
+	    argv++;
+	}
 
-    if (argv[0] && !strncmp("--max-count", argv[0], sizeof "--max-count"))
-    {
-	argv++;
-	simulation_count = stoul(argv[0]);
-	has_simulation_count = true;
-	argv++;
-    }
+	if (argv[0] && !strncmp("--exact-match", argv[0], sizeof "--exact-match"))
+	{
+	    exact_match = true;
+	    argv++;
+	}
 
-    if (argv[0] && !strncmp("--probe-delay", argv[0], sizeof "--probe-delay"))
-    {
-	argv++;
-	probe_delay = stoul(argv[0]);
-	argv++;
-    }
+	if (argv[0] && !strncmp("--max-count", argv[0], sizeof "--max-count"))
+	{
+	    argv++;
 
-    if (argv[0] && !strncmp("--pass-count", argv[0], sizeof "--pass-count"))
-    {
-	argv++;
-	pass_count = stoul(argv[0]);
-	argv++;
+	    if (!argv[0])
+		throw SyntaxError("Missing simulation count after \"--max-count\" argument.");
+
+	    simulation_count = stoul(argv[0]);
+	    has_simulation_count = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--probe-delay", argv[0], sizeof "--probe-delay"))
+	{
+	    argv++;
+
+	    if (!argv[0])
+		throw SyntaxError("Missing delay after \"--probe-delay\" argument.");
+
+	    probe_delay = stoul(argv[0]);
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--pass-count", argv[0], sizeof "--pass-count"))
+	{
+	    argv++;
+
+	    if (!argv[0])
+		throw SyntaxError("Missing pass count after \"--pass-count\" argument.");
+
+	    pass_count = stoul(argv[0]);
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--tune-gemm", argv[0], sizeof "--tune-gemm"))
+	{
+	    tune_gemm = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--build-variants", argv[0], sizeof "--build-variants"))
+	{
+	    build_variants = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--item-widths", argv[0], sizeof "--item-widths"))
+	{
+	    item_widths = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--precisions", argv[0], sizeof "--precisions"))
+	{
+	    precisions = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--probe-gemm", argv[0], sizeof "--probe-gemm"))
+	{
+	    probe_gemm = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--verify", argv[0], sizeof "--verify"))
+	{
+	    verify_gemm = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--stream-size", argv[0], sizeof "--stream-size"))
+	{
+	    argv++;
+
+	    if (!argv[0])
+		throw SyntaxError("Missing matrix size after \"--stream-size\" argument.");
+
+	    stream_size = stoul(argv[0]);
+	    probe_gemm = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--stream-block", argv[0], sizeof "--stream-block"))
+	{
+	    argv++;
+
+	    if (!argv[0])
+		throw SyntaxError("Missing block size after \"--stream-block\" argument.");
+
+	    stream_block = stoul(argv[0]);
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--strassen", argv[0], sizeof "--strassen"))
+	{
+	    strassen = true;
+	    probe_gemm = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--half-storage", argv[0], sizeof "--half-storage"))
+	{
+	    half_storage = true;
+	    probe_gemm = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--batched", argv[0], sizeof "--batched"))
+	{
+	    batched_gemm = true;
+	    probe_gemm = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--integer-gemm", argv[0], sizeof "--integer-gemm"))
+	{
+	    integer_gemm = true;
+	    probe_gemm = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--multi-device", argv[0], sizeof "--multi-device"))
+	{
+	    multi_device = true;
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--sub-devices", argv[0], sizeof "--sub-devices"))
+	{
+	    argv++;
+
+	    if (!argv[0])
+		throw SyntaxError("Missing sub-device count after \"--sub-devices\" argument.");
+
+	    sub_devices = stoul(argv[0]);
+	    argv++;
+	}
+
+	if (argv[0] && !strncmp("--vector-width", argv[0], sizeof "--vector-width"))
+	{
+	    argv++;
+
+	    if (!argv[0])
+		throw SyntaxError("Missing vector width after \"--vector-width\" argument.");
+
+	    vector_width = stoul(argv[0]);
+	    argv++;
+	}
+
+	if (argv == optionsStart)
+	    break;
     }
 
     return argv;
@@ -220,8 +462,7 @@ char const * const *CmdLineArgs::parsePlatformSelection(char const * const argv[
 	switch (state)
 	{
 	case ReadActions:
-	    if (!(listAction || probeAction))
-		listAction = true;
+	    defaultAction();
 	    break;
 	case ReadPlatform:
 	    break;
@@ -241,8 +482,7 @@ char const * const *CmdLineArgs::parsePlatformSelection(char const * const argv[
 	switch (state)
 	{
 	case ReadActions:
-	    if (!(listAction || probeAction))
-		listAction = true;
+	    defaultAction();
 	    break;
 	case ReadPlatform:
 	    break;
@@ -275,8 +515,7 @@ char const * const *CmdLineArgs::parsePlatfromDevices(char const * const argv[])
 	switch (state)
 	{
 	case ReadActions:
-	    if (!(listAction || probeAction))
-		listAction = true;
+	    defaultAction();
 	    state = ReadDevices;
 	    break;
 	case ReadPlatform:
@@ -296,8 +535,7 @@ char const * const *CmdLineArgs::parsePlatfromDevices(char const * const argv[])
 	switch (state)
 	{
 	case ReadActions:
-	    if (!(listAction || probeAction))
-		listAction = true;
+	    defaultAction();
 	    state = ReadDevices;
 	    break;
 	case ReadPlatform:
@@ -28,9 +28,24 @@ struct CmdLineArgs
     bool opencl_order = false;
     bool exact_match = false;
     bool has_simulation_count = false;
+    bool tune_gemm = false;
+    bool build_variants = false;
+    bool item_widths = false;
+    bool precisions = false;
+    bool probe_gemm = false;
+    bool verify_gemm = false;
+    bool multi_device = false;
+    bool strassen = false;
+    bool half_storage = false;
+    bool batched_gemm = false;
+    bool integer_gemm = false;
     unsigned long simulation_count = 500;
     unsigned int  probe_delay = 0u;
     unsigned int  pass_count = 3u;
+    unsigned int  vector_width = 0u;
+    unsigned long stream_size = 0u;
+    unsigned long stream_block = 0u;
+    unsigned int  sub_devices = 0u;
     void parse(char const * const argv[]);
 
 protected:
@@ -39,6 +54,7 @@ protected:
     char const *platform = nullptr;
     std::vector<char const *> devices;
 
+    void defaultAction();
     void restartParser(bool resetActions = false);
     void newCommand(SelectionSet &selectionSet, bool clearDevices);
     void flushPendingCommand();
@@ -0,0 +1,80 @@
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "timing-stats.hh"
+
+using std::size_t;
+using std::uint64_t;
+using std::floor;
+using std::fabs;
+using std::sort;
+using std::vector;
+using std::mt19937;
+using std::uniform_int_distribution;
+
+// Percentile of sorted values, with linear interpolation between the closest ranks
+static double percentile(vector<double> const &sorted, double fraction)
+{
+    double const rank = fraction * (sorted.size() - 1u);
+    size_t const lower = static_cast<size_t>(floor(rank));
+
+    if (lower + 1u >= sorted.size())
+	return sorted.back();
+
+    return sorted[lower] + (rank - lower) * (sorted[lower + 1u] - sorted[lower]);
+}
+
+static double median(vector<double> &values)
+{
+    sort(values.begin(), values.end());
+
+    return percentile(values, 0.5);
+}
+
+extern TimingStats timing_stats(vector<uint64_t> const &samples, double confidence, unsigned resampleCount)
+{
+    TimingStats stats;
+
+    if (samples.empty())
+	return stats;
+
+    vector<double> values(samples.begin(), samples.end()), deviations(values.size());
+
+    stats.count = values.size();
+    stats.median = median(values);
+    stats.p5 = percentile(values, 0.05);
+    stats.p95 = percentile(values, 0.95);
+
+    for (size_t i = 0u; i < values.size(); i++)
+	deviations[i] = fabs(values[i] - stats.median);
+
+    stats.mad = median(deviations);
+    stats.ciLow = stats.ciHigh = stats.median;
+
+    if (!resampleCount)
+	return stats;
+
+    // Median of each resample, drawn with replacement from the samples
+    mt19937 generator(values.size());
+    uniform_int_distribution<size_t> sampleIndex(0u, values.size() - 1u);
+    vector<double> resample(values.size()), resampleMedians(resampleCount);
+
+    for (auto &resampleMedian: resampleMedians)
+    {
+	for (auto &value: resample)
+	    value = values[sampleIndex(generator)];
+
+	resampleMedian = median(resample);
+    }
+
+    sort(resampleMedians.begin(), resampleMedians.end());
+
+    stats.ciLow = percentile(resampleMedians, (1.0 - confidence) / 2.0);
+    stats.ciHigh = percentile(resampleMedians, (1.0 + confidence) / 2.0);
+
+    return stats;
+}
@@ -0,0 +1,41 @@
+#if !defined(TIMING_STATS_HH)
+#define TIMING_STATS_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+// Robust summary of repeated time measurements, in the unit of the samples (nanoseconds for the profiling
+// events), that is not thrown off by the odd slow run
+struct TimingStats
+{
+    std::size_t count = 0u;
+    double median = 0.0;
+    double mad = 0.0;			// median absolute deviation from the median
+    double p5 = 0.0, p95 = 0.0;		// 5th and 95th percentiles
+    double ciLow = 0.0, ciHigh = 0.0;	// bootstrap confidence interval for the median
+
+    // Width of the confidence interval, relative to the median
+    double relativeInterval() const;
+
+    // The confidence interval is narrower than targetInterval relative to the median, or than two ticks
+    // of a timer with the given resolution, which is as narrow as the timer can tell
+    bool isNarrow(double targetInterval, double timerResolution) const;
+};
+
+// Statistics for the samples, with the confidence interval of the median from resampleCount bootstrap
+// resamples. The resamples use a fixed seed, so the same samples always give the same interval.
+extern TimingStats timing_stats(std::vector<std::uint64_t> const &samples, double confidence = 0.95, unsigned resampleCount = 1000u);
+
+inline double TimingStats::relativeInterval() const
+{
+    return median > 0.0 ? (ciHigh - ciLow) / median : 0.0;
+}
+
+inline bool TimingStats::isNarrow(double targetInterval, double timerResolution) const
+{
+    return ciHigh - ciLow <= std::max(targetInterval * median, 2.0 * timerResolution);
+}
+
+#endif // !defined(TIMING_STATS_HH)
@@ -0,0 +1,124 @@
+#include <cstdlib>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__MACOSX__)
+# include <OpenCL/cl2.hpp>
+#else
+# include <CL/cl2.hpp>
+#endif
+
+#include "host-matrix-mult.hh"
+
+using std::size_t;
+using std::cerr;
+using std::endl;
+using std::vector;
+
+static unsigned failureCount = 0u;
+
+static void check(char const *name, bool passed)
+{
+    cerr << name << ": " << (passed ? "passed" : "FAILED") << endl;
+
+    if (!passed)
+	failureCount++;
+}
+
+// Small integer values, so the products and their sums are exact in float and double
+template<typename FloatType>
+    static vector<FloatType> small_values(size_t count, size_t seed)
+{
+    vector<FloatType> values(count);
+
+    for (size_t i = 0u; i < count; i++)
+	values[i] = static_cast<FloatType>(static_cast<int>((i * 7u + seed) % 9u) - 4);
+
+    return values;
+}
+
+template<typename FloatType>
+    static vector<FloatType> naive_multiply(size_t lines, size_t cols, size_t inner, vector<FloatType> const &m, vector<FloatType> const &n)
+{
+    vector<FloatType> result(lines * cols);
+
+    for (size_t i = 0u; i < lines; i++)
+	for (size_t j = 0u; j < cols; j++)
+	    for (size_t k = 0u; k < inner; k++)
+		result[i * cols + j] += m[i * inner + k] * n[k * cols + j];
+
+    return result;
+}
+
+// Sizes over the cache blocks of host_multiply(), and not a multiple of them, with one thread, a few
+// threads and all hardware threads
+template<typename FloatType>
+    static bool multiply_blocks(size_t lines, size_t cols, size_t inner)
+{
+    vector<FloatType> const
+	m = small_values<FloatType>(lines * inner, 1u),
+	n = small_values<FloatType>(inner * cols, 2u),
+	expected = naive_multiply(lines, cols, inner, m, n);
+
+    for (unsigned threadCount: { 1u, 3u, 0u })
+    {
+	vector<FloatType> result(lines * cols, FloatType(-1));
+
+	host_multiply(lines, cols, inner, m.data(), inner, n.data(), cols, result.data(), cols, threadCount);
+
+	if (result != expected || relative_error(result.data(), expected.data(), result.size()) != 0.0)
+	    return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    // 2x3 times 3x2
+    vector<double> const
+	m { 1.0, 2.0, 3.0, 4.0, 5.0, 6.0 },
+	n { 7.0, 8.0, 9.0, 10.0, 11.0, 12.0 },
+	expected { 58.0, 64.0, 139.0, 154.0 };
+    vector<double> result(4u);
+
+    host_multiply(2u, 2u, 3u, m.data(), 3u, n.data(), 2u, result.data(), 2u);
+    check("known product", result == expected);
+
+    // The same product as a tile at (1, 1) of a 4x5 result, with the operands in wider lines
+    vector<double> const
+	wideM { 0.0, 1.0, 2.0, 3.0, 0.0, 4.0, 5.0, 6.0 },
+	wideN { 7.0, 8.0, 0.0, 0.0, 9.0, 10.0, 0.0, 0.0, 11.0, 12.0, 0.0, 0.0 };
+    vector<double> tile(20u, -1.0);
+
+    host_multiply(2u, 2u, 3u, wideM.data() + 1u, 4u, wideN.data(), 4u, tile.data() + 6u, 5u);
+
+    check
+	(
+	    "product in a tile",
+	    tile[6u] == 58.0 && tile[7u] == 64.0 && tile[11u] == 139.0 && tile[12u] == 154.0
+		&&
+	    tile[5u] == -1.0 && tile[8u] == -1.0 && tile[10u] == -1.0 && tile[13u] == -1.0 && tile[1u] == -1.0 && tile[16u] == -1.0
+	);
+
+    check("product over the cache blocks (float)", multiply_blocks<cl_float>(70u, 300u, 150u));
+    check("product over the cache blocks (double)", multiply_blocks<cl_double>(33u, 257u, 131u));
+
+    // Error of one perturbed element, relative to the largest expected value
+    vector<double> perturbed(expected);
+
+    check("no error for the same values", relative_error(expected.data(), expected.data(), expected.size()) == 0.0);
+
+    perturbed[1u] += 0.5;
+    check("error of a perturbed value", relative_error(perturbed.data(), expected.data(), expected.size()) == 0.5 / 154.0);
+
+    perturbed[2u] -= 1.0;
+    check("largest error of perturbed values", relative_error(perturbed.data(), expected.data(), expected.size()) == 1.0 / 154.0);
+
+    vector<cl_float> const zeros(4u), offset { 0.0f, 0.25f, 0.0f, 0.0f };
+
+    check("absolute error for zero expected values", relative_error(offset.data(), zeros.data(), zeros.size()) == 0.25);
+
+    return failureCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}
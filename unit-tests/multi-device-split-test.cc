@@ -0,0 +1,103 @@
+#include <cstdlib>
+#include <cstddef>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "cl-matrix-multi.hh"
+
+using std::size_t;
+using std::fabs;
+using std::cerr;
+using std::endl;
+using std::vector;
+
+static unsigned failureCount = 0u;
+
+static void check(char const *name, bool passed)
+{
+    cerr << name << ": " << (passed ? "passed" : "FAILED") << endl;
+
+    if (!passed)
+	failureCount++;
+}
+
+// Each owner gets its share of the items by weight, give or take one item
+static bool proportional(vector<double> const &weights, size_t count)
+{
+    vector<unsigned> const owners = weighted_round_robin(weights, count);
+    vector<size_t> ownerCounts(weights.size());
+    double totalWeight = 0.0;
+
+    for (double weight: weights)
+	totalWeight += weight;
+
+    for (unsigned owner: owners)
+	if (owner < weights.size())
+	    ownerCounts[owner]++;
+	else
+	    return false;
+
+    for (size_t i = 0u; i < weights.size(); i++)
+	if (fabs(ownerCounts[i] - count * weights[i] / totalWeight) > 1.0)
+	    return false;
+
+    return owners.size() == count;
+}
+
+// The regions of all the owners cover each element of the lines x cols result exactly once
+static bool covered_once(vector<double> const &weights, cl::size_type lines, cl::size_type cols, cl::size_type blockSize)
+{
+    cl::size_type const blockCount = ((lines + blockSize - 1u) / blockSize) * ((cols + blockSize - 1u) / blockSize);
+    vector<unsigned> const owners = weighted_round_robin(weights, blockCount);
+    vector<unsigned> coverCount(lines * cols);
+    size_t regionCount = 0u;
+
+    for (unsigned owner = 0u; owner < weights.size(); owner++)
+	for (MatrixRegion const &region: owned_blocks(owners, owner, lines, cols, blockSize))
+	{
+	    if
+		(
+		    !region.lines || !region.cols || region.lines > blockSize || region.cols > blockSize
+			||
+		    region.line + region.lines > lines || region.col + region.cols > cols
+		)
+	    {
+		return false;
+	    }
+
+	    for (cl::size_type i = region.line; i < region.line + region.lines; i++)
+		for (cl::size_type j = region.col; j < region.col + region.cols; j++)
+		    coverCount[i * cols + j]++;
+
+	    regionCount++;
+	}
+
+    for (unsigned count: coverCount)
+	if (count != 1u)
+	    return false;
+
+    return regionCount == blockCount;
+}
+
+int main()
+{
+    vector<double> const
+	equal { 1.0, 1.0 },
+	uneven { 3.0, 1.0, 0.5 },
+	single { 2.5 };
+
+    check("equal weights", proportional(equal, 64u) && proportional(equal, 65u));
+    check("uneven weights", proportional(uneven, 90u) && proportional(uneven, 97u) && proportional(uneven, 5u));
+    check("single owner", proportional(single, 17u));
+
+    // The fastest owner first, and the others interleaved with it, not grouped
+    check("interleaved owners", weighted_round_robin(uneven, 9u) == vector<unsigned> { 0u, 1u, 0u, 0u, 2u, 0u, 0u, 1u, 0u });
+
+    check("blocks of an exact multiple", covered_once(uneven, 256u, 128u, 32u));
+    check("blocks with a remainder", covered_once(uneven, 250u, 131u, 32u));
+    check("blocks larger than the result", covered_once(equal, 7u, 5u, 32u));
+    check("one owner covers all blocks", covered_once(single, 100u, 70u, 16u));
+
+    return failureCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "cl-program-cache.hh"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+static unsigned failureCount = 0u;
+
+static void check(char const *name, bool passed)
+{
+    cerr << name << ": " << (passed ? "passed" : "FAILED") << endl;
+
+    if (!passed)
+	failureCount++;
+}
+
+int main()
+{
+    string const
+	device = "Example GPU",
+	driver = "1.2.3",
+	source = "kernel void copy(global float *a, global float const *b) { a[get_global_id(0)] = b[get_global_id(0)]; }\n",
+	options = "-cl-std=CL1.1 -DFLOAT_TYPE=float -DTILE_SIZE=32",
+	key = program_cache_key(device, driver, source, options);
+
+    check("same key for the same program", key == program_cache_key(device, driver, source, options));
+    check("same key for a copy of the source", key == program_cache_key(device, driver, string(source.begin(), source.end()), options));
+
+    // Device info strings come with the null terminator from the driver
+    check("same key for the device name from the driver", key == program_cache_key(device + '\0', driver + '\0', source, options));
+
+    check("new key for another source", key != program_cache_key(device, driver, source + ' ', options));
+    check("new key for a one character change", key != program_cache_key(device, driver, "kernel void copy(global float *a, global float const *b) { a[get_global_id(0)] = b[get_global_id(1)]; }\n", options));
+    check("new key for other options", key != program_cache_key(device, driver, source, "-cl-std=CL1.1 -DFLOAT_TYPE=float -DTILE_SIZE=16"));
+    check("new key without the options", key != program_cache_key(device, driver, source, ""));
+    check("new key for another device", key != program_cache_key("Example GPU 2", driver, source, options));
+    check("new key for another driver", key != program_cache_key(device, "1.2.4", source, options));
+
+    // The fields are tab separated, so a part of the device name can not pass for the driver version
+    check("fields kept apart", program_cache_key("Example", "GPU 1.2.3", source, options) != program_cache_key("Example GPU", "1.2.3", source, options));
+
+    return failureCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "cl-matrix-strassen.hh"
+
+using std::cerr;
+using std::endl;
+using std::vector;
+
+static unsigned failureCount = 0u;
+
+static void check(char const *name, bool passed)
+{
+    cerr << name << ": " << (passed ? "passed" : "FAILED") << endl;
+
+    if (!passed)
+	failureCount++;
+}
+
+// Blocks of a blockCount x blockCount grid, for a power of 2, take each position in [0, blockCount^2) once,
+// and the blocks of each quadrant at each level take consecutive positions, in the order 11, 12, 21, 22
+static bool recursive_layout(cl::size_type blockCount)
+{
+    vector<unsigned> positionCount(blockCount * blockCount);
+
+    for (cl::size_type i = 0u; i < blockCount; i++)
+	for (cl::size_type j = 0u; j < blockCount; j++)
+	{
+	    cl::size_type const index = quadrant_index(i, j);
+
+	    if (index >= positionCount.size())
+		return false;
+
+	    positionCount[index]++;
+
+	    for (cl::size_type quadrantSize = blockCount / 2u; quadrantSize; quadrantSize /= 2u)
+	    {
+		cl::size_type const
+		    quadrantBlocks = quadrantSize * quadrantSize,
+		    quadrant = (i / quadrantSize % 2u) * 2u + j / quadrantSize % 2u;
+
+		if (index / quadrantBlocks % 4u != quadrant)
+		    return false;
+	    }
+	}
+
+    for (unsigned count: positionCount)
+	if (count != 1u)
+	    return false;
+
+    return true;
+}
+
+// Leaves of the given depth are no larger than the crossover, and leaves of one level less are larger
+static bool smallest_depth(cl::size_type size, cl::size_type crossover)
+{
+    unsigned const depth = MatrixStrassen::recursionDepth(size, crossover);
+    auto const leafSize = [size](unsigned levels) { return (size + (cl::size_type(1u) << levels) - 1u) >> levels; };
+
+    return leafSize(depth) <= crossover && (!depth || leafSize(depth - 1u) > crossover);
+}
+
+int main()
+{
+    check
+	(
+	    "quadrant positions",
+	    quadrant_index(0u, 0u) == 0u && quadrant_index(0u, 1u) == 1u && quadrant_index(1u, 0u) == 2u && quadrant_index(1u, 1u) == 3u
+		&&
+	    quadrant_index(0u, 2u) == 4u && quadrant_index(2u, 0u) == 8u && quadrant_index(3u, 3u) == 15u && quadrant_index(5u, 6u) == 54u
+	);
+
+    check("recursive layout of 1 block", recursive_layout(1u));
+    check("recursive layout of 4 x 4 blocks", recursive_layout(4u));
+    check("recursive layout of 16 x 16 blocks", recursive_layout(16u));
+
+    check("no recursion without a crossover", MatrixStrassen::recursionDepth(4096u, 0u) == 0u);
+    check("no recursion up to the crossover", MatrixStrassen::recursionDepth(512u, 512u) == 0u && MatrixStrassen::recursionDepth(100u, 512u) == 0u);
+
+    check
+	(
+	    "recursion depth of powers of 2",
+	    MatrixStrassen::recursionDepth(1024u, 512u) == 1u && MatrixStrassen::recursionDepth(4096u, 512u) == 3u
+		&&
+	    MatrixStrassen::recursionDepth(8192u, 256u) == 5u
+	);
+
+    check("recursion depth of other sizes", MatrixStrassen::recursionDepth(513u, 512u) == 1u && MatrixStrassen::recursionDepth(1025u, 512u) == 2u);
+
+    bool smallest = true;
+
+    for (cl::size_type crossover: { 1u, 3u, 64u, 500u, 512u })
+	for (cl::size_type size = 1u; size <= 5000u; size += 37u)
+	    smallest = smallest_depth(size, crossover) && smallest;
+
+    check("smallest recursion depth for the crossover", smallest);
+
+    return failureCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}
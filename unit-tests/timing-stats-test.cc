@@ -0,0 +1,85 @@
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "timing-stats.hh"
+
+using std::uint64_t;
+using std::fabs;
+using std::cerr;
+using std::endl;
+using std::vector;
+
+static unsigned failureCount = 0u;
+
+static void check(char const *name, bool passed)
+{
+    cerr << name << ": " << (passed ? "passed" : "FAILED") << endl;
+
+    if (!passed)
+	failureCount++;
+}
+
+static bool is_close(double value, double expected)
+{
+    return fabs(value - expected) <= 1.0e-9 * fabs(expected);
+}
+
+int main()
+{
+    vector<uint64_t> const
+	ranks { 90u, 10u, 50u, 30u, 70u, 20u, 80u, 40u, 60u },
+	constant(16u, 1000u),
+	outlier { 100u, 101u, 99u, 100u, 102u, 98u, 100u, 1000000u, 100u };
+
+    TimingStats const
+	empty = timing_stats(vector<uint64_t>()),
+	rankStats = timing_stats(ranks),
+	rankStatsAgain = timing_stats(ranks),
+	constantStats = timing_stats(constant),
+	outlierStats = timing_stats(outlier),
+	noResampling = timing_stats(ranks, 0.95, 0u);
+
+    check("empty samples", empty.count == 0u && empty.median == 0.0 && empty.relativeInterval() == 0.0);
+
+    check("median of fixed samples", rankStats.count == ranks.size() && is_close(rankStats.median, 50.0));
+    check("percentiles of fixed samples", is_close(rankStats.p5, 14.0) && is_close(rankStats.p95, 86.0));
+    check("median absolute deviation", is_close(rankStats.mad, 20.0));
+
+    check
+	(
+	    "bootstrap interval around the median",
+	    rankStats.ciLow <= rankStats.median && rankStats.median <= rankStats.ciHigh && rankStats.ciLow >= 10.0 && rankStats.ciHigh <= 90.0
+		&&
+	    rankStats.ciLow < rankStats.ciHigh
+	);
+
+    check("bootstrap interval is repeatable", rankStats.ciLow == rankStatsAgain.ciLow && rankStats.ciHigh == rankStatsAgain.ciHigh);
+    check("no resampling", noResampling.ciLow == noResampling.median && noResampling.ciHigh == noResampling.median);
+
+    check
+	(
+	    "constant samples",
+	    constantStats.median == 1000.0 && constantStats.mad == 0.0 && constantStats.ciLow == 1000.0 && constantStats.ciHigh == 1000.0
+		&&
+	    constantStats.relativeInterval() == 0.0
+	);
+
+    check("outlier does not move the median", is_close(outlierStats.median, 100.0) && outlierStats.mad <= 1.0 && outlierStats.ciHigh < 1000.0);
+
+    // Interval of 20 ns around a median of 1000 ns, which is 2% of the median
+    TimingStats interval;
+
+    interval.count = 9u;
+    interval.median = 1000.0;
+    interval.ciLow = 990.0;
+    interval.ciHigh = 1010.0;
+
+    check("relative interval", is_close(interval.relativeInterval(), 0.02));
+    check("interval within the target", interval.isNarrow(0.02, 0.0) && !interval.isNarrow(0.01, 0.0));
+    check("interval within two timer ticks", interval.isNarrow(0.01, 10.0) && !interval.isNarrow(0.01, 9.0));
+    check("timer floor over the target", interval.isNarrow(0.0, 10.0) && !interval.isNarrow(0.0, 1.0));
+
+    return failureCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}